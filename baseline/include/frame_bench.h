@@ -0,0 +1,111 @@
+#ifndef FRAME_BENCH_H_
+#define FRAME_BENCH_H_
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "framestats.h"
+#include "gldebug.h"
+#include "gpuprofiler.h"
+#include "spennytypes.h"
+
+// Frame timing for the baseline's --bench mode. Records CPU and GPU time
+// for every frame and every named pass, then reports percentiles as JSON
+// once the run is over, along with the renderer's per-frame GL counters.
+// GPU times come from sr::GpuProfiler, which reads its timestamp queries
+// back a few frames later, so measuring never stalls the GPU. Without
+// SPENNY_PROFILE there is no GPU profiler and the GPU times are null.
+//
+// All calls are no-ops until start() is called, so the frame loop can be
+// instrumented unconditionally.
+class FrameBench
+{
+public:
+    FrameBench() = default;
+    ~FrameBench();
+
+    FrameBench(const FrameBench&) = delete;
+    FrameBench& operator=(const FrameBench&) = delete;
+
+    void start(u32 n_frames, u32 n_warmup);
+
+    bool enabled() const { return n_frames > 0; }
+    bool done() const { return enabled() && frame >= n_warmup + n_frames; }
+
+    // frames since start(), warmup included. Drives the camera path.
+    u32 frame_index() const { return frame; }
+
+    void begin_frame();
+    void end_frame();
+
+    // A named pass for the rest of the scope. Also a GPU profiler pass and a
+    // GL debug group, name has to outlive the bench.
+    class Pass
+    {
+    public:
+        Pass(FrameBench& bench, const char* name)
+            : bench(bench)
+        {
+            bench.begin_pass(name);
+        }
+        ~Pass() { bench.end_pass(); }
+
+        Pass(const Pass&) = delete;
+        Pass& operator=(const Pass&) = delete;
+
+    private:
+        FrameBench& bench;
+    };
+
+    // Extra numbers reported under "scene", e.g. instance counts
+    void set_info(const std::string& key, u64 value);
+
+    void write_json(std::ostream& os);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr u32 MAX_PASSES = 32;
+
+    // GPU times stay negative until the profiler reports the frame
+    struct PassSample
+    {
+        u32 pass;
+        f64 cpu_ms;
+        f64 gpu_ms;
+    };
+
+    struct FrameSample
+    {
+        // the GpuProfiler's number for the frame
+        u64 gpu_frame;
+        f64 cpu_ms;
+        f64 gpu_ms;
+        sr::FrameStats stats;
+        std::vector<PassSample> passes;
+    };
+
+    void begin_pass(const char* name);
+    void end_pass();
+
+    bool recording() const;
+    u32 pass_id(const char* name);
+    static void on_gpu_frame(const sr::GpuFrameTiming& timing, void* user);
+
+    u32 n_frames = 0;
+    u32 n_warmup = 0;
+    u32 frame = 0;
+
+    std::vector<std::pair<std::string, u64>> info;
+    // names as passed to Pass, room for MAX_PASSES is reserved up front
+    std::vector<const char*> pass_names;
+    std::vector<FrameSample> samples;
+
+    Clock::time_point frame_start;
+    Clock::time_point pass_start;
+};
+
+#endif // FRAME_BENCH_H_
@@ -2,71 +2,59 @@
 #define SHADER_SRC_H_
 
 const char* depth_prepass_vsrc = R"SRC(
-#version 400 core
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec3 tangent;
-layout (location = 3) in vec3 bitangent;
-layout (location = 4) in vec2 uv;
-
-layout (std140) uniform GlobalUniforms
-{
-    vec4 clip;
-    vec4 camera_pos;
-    vec4 material_props;
-    mat4 view;
-    mat4 perspective;
-};
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
 
-uniform mat4 model_to_world;
+#include "packed_vertex"
+#include "global_uniforms"
+#include "draw_data"
 
 void main()
 {
-    vec4 world_pos = model_to_world * vec4(position, 1.0);
+    vec4 world_pos = objects[gl_BaseInstanceARB].model_to_world * vec4(vertex_position(), 1.0);
     gl_Position = perspective * view * world_pos;
 }
 )SRC";
 
 const char* vs_shader_src = R"SRC(
-#version 400 core
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec3 tangent;
-layout (location = 3) in vec3 bitangent;
-layout (location = 4) in vec2 uv;
-
-layout (std140) uniform GlobalUniforms
-{
-    vec4 clip;
-    vec4 camera_pos;
-    vec4 material_props;
-    mat4 view;
-    mat4 perspective;
-};
-
-uniform mat4 model_to_world;
+#include "packed_vertex"
+#include "global_uniforms"
+#include "draw_data"
 
 out vec2 tex;
 out vec3 frag_world_pos;
 out vec3 norm;
+#ifdef SR_NORMAL_MAP
 out mat3 tan_cob;
+#endif
+flat out uint material;
 
 void main()
 {
-    vec4 world_pos = model_to_world * vec4(position, 1.0);
+    ObjectData object = objects[gl_BaseInstanceARB];
+    material = object.material.x;
+
+    vec4 world_pos = object.model_to_world * vec4(vertex_position(), 1.0);
     gl_Position = perspective * view * world_pos;
 
-    tex = uv;
+    tex = vertex_uv();
     frag_world_pos = world_pos.xyz;
 
-    mat3 normal_mat = transpose(inverse(mat3(model_to_world)));
+    mat3 normal_mat = mat3(object.normal_to_world);
 
+    vec3 normal = vertex_normal();
     vec3 transform_norm = normalize(normal_mat * normal);
-    vec3 transform_tan = normalize(normal_mat * tangent);
+#ifdef SR_NORMAL_MAP
+    vec4 tangent = vertex_tangent();
+    vec3 bitangent = cross(normal, tangent.xyz) * tangent.w;
+    vec3 transform_tan = normalize(normal_mat * tangent.xyz);
     vec3 transform_bitan = normalize(normal_mat * bitangent);
 
     tan_cob = mat3(transform_tan, transform_bitan, transform_norm);
+#endif
     norm = transform_norm;
 }
 )SRC";
@@ -78,26 +66,32 @@ void main() {}
 )SRC";
 
 const char* fs_shader_src = R"SRC(
-#version 400 core
+#version 430 core
 
 in vec2 tex;
 in vec3 frag_world_pos;
+#ifdef SR_NORMAL_MAP
 in mat3 tan_cob;
+#endif
 in vec3 norm;
+flat in uint material;
 
-layout (std140) uniform GlobalUniforms
-{
-    vec4 clip;
-    vec4 camera_pos;
-    vec4 material_props;
-    mat4 view;
-    mat4 perspective;
-};
+#include "global_uniforms"
+#include "draw_data"
 
 float pi = 3.14159;
 
-uniform sampler2D teximg;
-uniform sampler2D normals;
+// fixed units, so every variant is valid to draw with before any uniform is set
+layout (binding = 0) uniform sampler2D teximg;
+layout (binding = 1) uniform sampler2D normals;
+
+// two texels per light, position then colour
+layout (binding = 2) uniform samplerBuffer light_data;
+#ifdef SR_LIGHT_COUNT
+const int n_lights = SR_LIGHT_COUNT;
+#else
+uniform int n_lights;
+#endif
 
 out vec4 FragColor;
 
@@ -130,38 +124,35 @@ vec3 fresn(float cosT, vec3 color, float metalness)
 
 void main()
 {
-    vec3 lights[4];
-    lights[0] = vec3(2, 2, 2);
-    lights[1] = vec3(-2, 2, 2);
-    lights[2] = vec3(2, 2, -2);
-    lights[3] = vec3(-2, 2, -2);
-    vec3 light_color = vec3(4, 4, 3.4);
-
+    vec4 material_props = materials[material].properties;
     float roughness = material_props.x;
     float metalness = material_props.y;
 
-    vec3 normal = vec3(0);
-    if (material_props.z > 0)
-    {
-        vec3 sampled_norm = texture(normals, tex).rgb;
-        sampled_norm = (sampled_norm * 2.0) - 1.0;
-        normal = normalize(tan_cob * sampled_norm);
-    }
-    else
-    {
-        normal = normalize(norm);
-    }
+#ifdef SR_NORMAL_MAP
+    vec3 sampled_norm = texture(normals, tex).rgb;
+    sampled_norm = (sampled_norm * 2.0) - 1.0;
+    vec3 normal = normalize(tan_cob * sampled_norm);
+#else
+    vec3 normal = normalize(norm);
+#endif
 
     vec3 view_dir = normalize(vec3(camera_pos) - frag_world_pos);
 
     vec4 albedo = texture(teximg, tex);
+#ifdef SR_ALPHA_TEST
+    if (albedo.a < material_props.w)
+    {
+        discard;
+    }
+#endif
 
     vec3 lambert = vec3(albedo / pi);
     vec3 final_color = vec3(0);
 
-    for (int i = 0; i < 4; i++)
+    for (int i = 0; i < n_lights; i++)
     {
-        vec3 light = lights[i];
+        vec3 light = texelFetch(light_data, i * 2).xyz;
+        vec3 light_color = texelFetch(light_data, i * 2 + 1).rgb;
         vec3 to_light = light - frag_world_pos;
 
 
@@ -196,6 +187,25 @@ void main()
 }
 )SRC";
 
+// Drawn with vs_shader_src while the PBR program compiles
+const char* fs_fallback_src = R"SRC(
+#version 400 core
+
+in vec2 tex;
+in vec3 norm;
+
+uniform sampler2D teximg;
+
+out vec4 FragColor;
+
+void main()
+{
+    vec4 albedo = texture(teximg, tex);
+    float light = 0.3 + 0.7 * max(dot(normalize(norm), normalize(vec3(0.3, 1.0, 0.2))), 0.0);
+    FragColor = vec4(albedo.rgb * light, albedo.a);
+}
+)SRC";
+
 const char* simple_quad_vsrc = R"SRC(
 #version 400 core
 
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sys/resource.h>
+
+#include "frame_bench.h"
+#include "renderer.h"
+
+FrameBench::~FrameBench()
+{
+    if (enabled())
+    {
+        sr::GpuProfiler::set_listener(nullptr, nullptr);
+    }
+}
+
+void FrameBench::start(u32 n_frames, u32 n_warmup)
+{
+    this->n_frames = n_frames;
+    this->n_warmup = n_warmup;
+    frame = 0;
+    samples.clear();
+    samples.reserve(n_frames);
+    // the first recorded frame may already be under the allocation guard
+    pass_names.reserve(MAX_PASSES);
+    sr::GpuProfiler::set_listener(&FrameBench::on_gpu_frame, this);
+}
+
+bool FrameBench::recording() const
+{
+    return enabled() && frame >= n_warmup && !done();
+}
+
+u32 FrameBench::pass_id(const char* name)
+{
+    for (u32 i = 0; i < pass_names.size(); i++)
+    {
+        if (!strcmp(pass_names[i], name))
+        {
+            return i;
+        }
+    }
+    pass_names.push_back(name);
+    return pass_names.size() - 1;
+}
+
+void FrameBench::begin_frame()
+{
+    if (!recording())
+    {
+        return;
+    }
+
+    // no allocation once the frame has begun
+    FrameSample sample;
+    sample.gpu_frame = 0;
+    sample.gpu_ms = -1;
+    sample.passes.reserve(std::max<usize>(pass_names.size(), 16));
+    samples.push_back(std::move(sample));
+    frame_start = Clock::now();
+}
+
+void FrameBench::end_frame()
+{
+    if (recording())
+    {
+        auto& sample = samples.back();
+        sample.gpu_frame = sr::GpuProfiler::last_frame();
+        sample.cpu_ms = std::chrono::duration<f64, std::milli>(Clock::now() - frame_start).count();
+        // Renderer::end_frame has already run, so this is the frame just done
+        sample.stats = sr::Renderer::get_frame_stats();
+    }
+
+    if (enabled())
+    {
+        frame++;
+    }
+}
+
+void FrameBench::begin_pass(const char* name)
+{
+    SR_GL_PUSH_GROUP(name);
+    SR_GPU_PROFILE_BEGIN(name);
+    if (!recording())
+    {
+        return;
+    }
+
+    PassSample pass;
+    pass.pass = pass_id(name);
+    pass.gpu_ms = -1;
+    samples.back().passes.push_back(pass);
+    pass_start = Clock::now();
+}
+
+void FrameBench::end_pass()
+{
+    SR_GPU_PROFILE_END();
+    SR_GL_POP_GROUP();
+    if (!recording())
+    {
+        return;
+    }
+
+    auto& pass = samples.back().passes.back();
+    pass.cpu_ms = std::chrono::duration<f64, std::milli>(Clock::now() - pass_start).count();
+}
+
+void FrameBench::on_gpu_frame(const sr::GpuFrameTiming& timing, void* user)
+{
+    auto& bench = *(FrameBench*)user;
+    // warmup frames, and the frame being recorded has no number yet
+    if (bench.samples.empty() || bench.samples.front().gpu_frame == 0
+        || timing.frame < bench.samples.front().gpu_frame)
+    {
+        return;
+    }
+    usize index = timing.frame - bench.samples.front().gpu_frame;
+    if (index >= bench.samples.size() || bench.samples[index].gpu_frame != timing.frame)
+    {
+        return;
+    }
+
+    auto& sample = bench.samples[index];
+    sample.gpu_ms = timing.frame_ms;
+    // both lists are in the order the passes began, match them up by name
+    usize next = 0;
+    for (auto& pass : sample.passes)
+    {
+        for (usize i = next; i < timing.passes.size(); i++)
+        {
+            if (!strcmp(bench.pass_names[pass.pass], timing.passes[i].name))
+            {
+                pass.gpu_ms = timing.passes[i].ms;
+                next = i + 1;
+                break;
+            }
+        }
+    }
+}
+
+void FrameBench::set_info(const std::string& key, u64 value)
+{
+    info.push_back({ key, value });
+}
+
+static void write_stats(std::ostream& os, std::vector<f64> values)
+{
+    if (values.empty())
+    {
+        os << "null";
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](f64 p)
+    {
+        usize rank = (usize)std::ceil(p * values.size());
+        return values[std::clamp<usize>(rank, 1, values.size()) - 1];
+    };
+    f64 sum = 0;
+    for (auto v : values)
+    {
+        sum += v;
+    }
+
+    os << "{\"min\": " << values.front()
+       << ", \"p50\": " << percentile(0.5)
+       << ", \"p90\": " << percentile(0.9)
+       << ", \"p99\": " << percentile(0.99)
+       << ", \"max\": " << values.back()
+       << ", \"mean\": " << sum / values.size()
+       << "}";
+}
+
+void FrameBench::write_json(std::ostream& os)
+{
+    // everything has been submitted, waiting on the results is fine now
+    sr::GpuProfiler::flush();
+
+    std::vector<f64> cpu_frame, gpu_frame;
+    std::vector<std::vector<f64>> cpu_pass(pass_names.size());
+    std::vector<std::vector<f64>> gpu_pass(pass_names.size());
+    for (auto& sample : samples)
+    {
+        cpu_frame.push_back(sample.cpu_ms);
+        // frames the profiler dropped, or all of them without SPENNY_PROFILE
+        if (sample.gpu_ms >= 0)
+        {
+            gpu_frame.push_back(sample.gpu_ms);
+        }
+        for (auto& pass : sample.passes)
+        {
+            cpu_pass[pass.pass].push_back(pass.cpu_ms);
+            if (pass.gpu_ms >= 0)
+            {
+                gpu_pass[pass.pass].push_back(pass.gpu_ms);
+            }
+        }
+    }
+
+    os << "{\n";
+    os << "  \"gl_renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+    os << "  \"gl_version\": \"" << glGetString(GL_VERSION) << "\",\n";
+    os << "  \"frames\": " << samples.size() << ",\n";
+    os << "  \"gpu_frames\": " << gpu_frame.size() << ",\n";
+    os << "  \"warmup\": " << n_warmup << ",\n";
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in kilobytes on Linux
+    os << "  \"peak_rss_bytes\": " << (u64)usage.ru_maxrss * 1024 << ",\n";
+
+    os << "  \"scene\": {";
+    for (usize i = 0; i < info.size(); i++)
+    {
+        os << (i ? ", " : "") << "\"" << info[i].first << "\": " << info[i].second;
+    }
+    os << "},\n";
+    os << "  \"cpu_frame_ms\": ";
+    write_stats(os, cpu_frame);
+    os << ",\n  \"gpu_frame_ms\": ";
+    write_stats(os, gpu_frame);
+    os << ",\n  \"passes\": {";
+    for (u32 i = 0; i < pass_names.size(); i++)
+    {
+        os << (i ? ",\n" : "\n") << "    \"" << pass_names[i] << "\": {\"cpu_ms\": ";
+        write_stats(os, cpu_pass[i]);
+        os << ", \"gpu_ms\": ";
+        write_stats(os, gpu_pass[i]);
+        os << "}";
+    }
+    os << "\n  },\n  \"frame_stats\": {";
+    auto write_counter = [&](const char* name, auto field, bool first = false)
+    {
+        std::vector<f64> values;
+        for (auto& sample : samples)
+        {
+            values.push_back(sample.stats.*field);
+        }
+        os << (first ? "\n" : ",\n") << "    \"" << name << "\": ";
+        write_stats(os, values);
+    };
+    write_counter("draw_calls", &sr::FrameStats::draw_calls, true);
+    write_counter("triangles", &sr::FrameStats::triangles);
+    write_counter("indirect_draws", &sr::FrameStats::indirect_draws);
+    write_counter("program_binds", &sr::FrameStats::program_binds);
+    write_counter("vao_binds", &sr::FrameStats::vao_binds);
+    write_counter("texture_binds", &sr::FrameStats::texture_binds);
+    write_counter("ubo_binds", &sr::FrameStats::ubo_binds);
+    write_counter("framebuffer_binds", &sr::FrameStats::framebuffer_binds);
+    write_counter("buffer_uploads", &sr::FrameStats::buffer_uploads);
+    write_counter("buffer_upload_bytes", &sr::FrameStats::buffer_upload_bytes);
+    write_counter("uniform_calls", &sr::FrameStats::uniform_calls);
+    write_counter("elided_calls", &sr::FrameStats::elided_calls);
+    write_counter("late_pipelines", &sr::FrameStats::late_pipelines);
+    write_counter("heap_allocs", &sr::FrameStats::heap_allocs);
+    write_counter("heap_bytes", &sr::FrameStats::heap_bytes);
+    os << "\n  }\n}" << std::endl;
+}
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -7,12 +10,24 @@
 #include "vertbuf.h"
 #include "spennymath.h"
 #include "framebuf.h"
+#include "gldebug.h"
+#include "glstate.h"
 #include "shader.h"
+#include "shadervariants.h"
 #include "texture.h"
+#include "alloctrack.h"
+#include "drawdata.h"
 #include "model.h"
+#include "pipeline.h"
+#include "programcache.h"
+#include "renderqueue.h"
+#include "profiler.h"
 #include "renderer.h"
+#include "stressscene.h"
+#include "vertpack.h"
 
 #include "shader_src.h"
+#include "frame_bench.h"
 
 #ifndef BASELINE_RESOURCE_DIR
 #define BASELINE_RESOURCE_DIR "./"
@@ -50,12 +65,228 @@ auto buffer_quad() -> sr::IndexedGeometry<SimpleVertex>
     return result;
 }
 
-auto main(void) -> int
+struct DrawItem
 {
-    sr::Renderer::start("spenny renderer - baseline PBR", 1280, 720);
+    u32 geometry;
+    sr::Material* material;
+    sm::Mat4 model_to_world;
+    sm::Mat4 normal_to_world;
+    // key of the PBR variant it's drawn with, set once all draws are known
+    u32 shader_features = 0;
+    // dense index of the material, for sort keys
+    u32 material_id = 0;
+};
+
+// Packs every mesh of the model and adds it to the arena, returns the index
+// of the first one in meshes. dequantize gets each mesh's
+// PackedVertices::dequantize.
+auto buffer_model(const sr::Model& model, sr::GeometryArena<sr::PackedVertex>& arena,
+                  std::vector<sr::GeometryHandle>& meshes, std::vector<sm::Mat4>& dequantize) -> u32
+{
+    u32 first = meshes.size();
+    u32 n_verts = arena.get_used_vertices();
+    u32 n_indices = arena.get_used_indices();
+    for (auto& mesh : model.meshes)
+    {
+        n_verts += mesh.verts.size();
+        n_indices += mesh.indices.size();
+    }
+    arena.reserve(n_verts, n_indices);
+
+    for (auto& mesh : model.meshes)
+    {
+        auto packed = sr::pack_vertices(mesh.verts);
+        meshes.push_back(arena.add(packed.positions.size(), mesh.indices.data(), mesh.indices.size(),
+                                   packed.positions.data(), packed.attributes.data()));
+        dequantize.push_back(packed.dequantize);
+    }
+    return first;
+}
+
+// Lights go to the PBR shader through a buffer texture, two texels per
+// light: position, then colour.
+auto buffer_lights(const std::vector<sr::PointLight>& lights) -> GLuint
+{
+    std::vector<sm::Vec4> texels;
+    texels.reserve(lights.size() * 2);
+    for (auto& light : lights)
+    {
+        texels.push_back(sm::extend(light.position, 1));
+        texels.push_back(sm::extend(light.color, 1));
+    }
+
+    GLuint buf, tex;
+    glGenBuffers(1, &buf);
+    sr::GLState::bind_buffer(GL_TEXTURE_BUFFER, buf);
+    glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(sm::Vec4), texels.data(), GL_STATIC_DRAW);
+
+    glGenTextures(1, &tex);
+    sr::GLState::bind_texture(GL_TEXTURE_BUFFER, tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buf);
+    return tex;
+}
+
+static void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " [--bench] [--frames N] [--warmup N] [--out PATH] [--trace PATH [--trace-frames N]] [--shader-cache DIR] [--shader-manifest PATH] [--alloc-guard N] [--direct-draws] [stress options]\n"
+              << "  --bench       render N frames offscreen along a fixed camera path,\n"
+              << "                then print frame time statistics as JSON\n"
+              << "  --frames N    measured frames in bench mode (default 600)\n"
+              << "  --warmup N    unmeasured frames before that (default 60)\n"
+              << "  --out PATH    write the JSON to PATH instead of stdout\n"
+              << "  --trace PATH  on exit write the last frames' CPU profile to PATH as a\n"
+              << "                Chrome trace (needs SPENNY_PROFILE)\n"
+              << "  --trace-frames N  frames in the trace (default 8)\n"
+              << "  --shader-cache DIR  keep linked program binaries in DIR between runs\n"
+              << "  --shader-manifest PATH  compile the shader variants listed in PATH at\n"
+              << "                startup, and write the ones this run used there on exit\n"
+              << "  --alloc-guard N  abort on any heap allocation inside a frame after the\n"
+              << "                first N frames (needs SPENNY_TRACK_ALLOCS)\n"
+              << "  --direct-draws  one draw call per mesh instead of a multi-draw indirect\n"
+              << "                per state change\n"
+              << "stress options replace the demo scene with a generated one:\n"
+              << "  --stress          generated scene with the defaults below\n"
+              << "  --stress-fox      instance the fox instead of generated meshes\n"
+              << "  --instances N     (default 1000)\n"
+              << "  --meshes N        unique meshes, at least 1 (default 16)\n"
+              << "  --materials N     (default 16, 0 keeps the fox's with --stress-fox)\n"
+              << "  --textures N      (default 8)\n"
+              << "  --lights N        (default 4)\n"
+              << "  --seed N          (default 1)\n";
+}
+
+auto main(int argc, char** argv) -> int
+{
+    bool bench_mode = false;
+    u32 bench_frames = 600;
+    u32 bench_warmup = 60;
+    std::string bench_out;
+
+    std::string trace_out;
+    u32 trace_frames = 8;
 
-    using VertBuf = sr::VertexBuffer<sr::Vertex>;
-    using IndexedGeom = sr::IndexedGeometry<sr::Vertex>;
+    std::string shader_cache_dir;
+    std::string shader_manifest;
+
+    bool alloc_guard = false;
+    u32 alloc_guard_warmup = 0;
+
+    bool direct_draws = false;
+
+    bool stress_mode = false;
+    bool stress_fox = false;
+    sr::StressSceneConfig stress_config;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--bench"))
+        {
+            bench_mode = true;
+        }
+        else if (!strcmp(argv[i], "--frames") && has_value)
+        {
+            bench_frames = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--warmup") && has_value)
+        {
+            bench_warmup = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--out") && has_value)
+        {
+            bench_out = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--trace") && has_value)
+        {
+            trace_out = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--trace-frames") && has_value)
+        {
+            trace_frames = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--shader-cache") && has_value)
+        {
+            shader_cache_dir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--shader-manifest") && has_value)
+        {
+            shader_manifest = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--alloc-guard") && has_value)
+        {
+            alloc_guard = true;
+            alloc_guard_warmup = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--direct-draws"))
+        {
+            direct_draws = true;
+        }
+        else if (!strcmp(argv[i], "--stress"))
+        {
+            stress_mode = true;
+        }
+        else if (!strcmp(argv[i], "--stress-fox"))
+        {
+            stress_mode = true;
+            stress_fox = true;
+        }
+        else if (!strcmp(argv[i], "--instances") && has_value)
+        {
+            stress_mode = true;
+            stress_config.n_instances = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--meshes") && has_value)
+        {
+            stress_mode = true;
+            stress_config.n_meshes = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--materials") && has_value)
+        {
+            stress_mode = true;
+            stress_config.n_materials = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--textures") && has_value)
+        {
+            stress_mode = true;
+            stress_config.n_textures = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--lights") && has_value)
+        {
+            stress_mode = true;
+            stress_config.n_lights = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--seed") && has_value)
+        {
+            stress_config.seed = std::stoul(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // generated instances pick from the generated meshes and materials, only
+    // the fox has its own to fall back on
+    if (stress_mode && !stress_fox && (stress_config.n_meshes == 0 || stress_config.n_materials == 0))
+    {
+        std::cerr << "--meshes and --materials need at least 1, --materials 0 only works with --stress-fox\n";
+        usage(argv[0]);
+        return 1;
+    }
+
+    u32 renderer_flags = bench_mode
+        ? sr::RendererFlags_Headless | sr::RendererFlags_NoVsync
+        : sr::RendererFlags_None;
+    if (!sr::Renderer::start("spenny renderer - baseline PBR", 1280, 720, renderer_flags))
+    {
+        return 1;
+    }
+
+    if (!shader_cache_dir.empty())
+    {
+        sr::ProgramCache::enable(shader_cache_dir);
+    }
 
     SDL_Event e;
     bool running = true;
@@ -66,13 +297,23 @@ auto main(void) -> int
         std::cout << "depth" << std::endl;
         return 1;
     }
+    depth_prepass.set_label("depth_prepass");
 
-    sr::Shader shader;
-    if (!shader.load_program(vs_shader_src, fs_shader_src))
+    sr::Shader fallback_shader;
+    if (!fallback_shader.load_program(vs_shader_src, fs_fallback_src))
     {
-        std::cout << "pbr" << std::endl;
+        std::cout << "fallback" << std::endl;
         return 1;
     }
+    fallback_shader.set_label("fallback");
+
+    // variants compile on first use and draw with the fallback until they're
+    // done, the ones in the manifest compile while the models load
+    sr::ShaderVariants pbr_variants(vs_shader_src, fs_shader_src, &fallback_shader);
+    if (!shader_manifest.empty())
+    {
+        pbr_variants.prewarm_from_manifest(shader_manifest);
+    }
 
     sr::Shader screen_shader;
     if (!screen_shader.load_program(simple_quad_vsrc, simple_quad_fsrc))
@@ -80,6 +321,7 @@ auto main(void) -> int
         std::cout << "screen" << std::endl;
         return 1;
     }
+    screen_shader.set_label("screen");
 
     sr::ModelLoader model_loader;
     auto maybe_model = model_loader.load_from_file(BASELINE_RESOURCE_DIR "/testarena/testlevel.glb");
@@ -99,6 +341,7 @@ auto main(void) -> int
     std::cout << "Loaded " << model.meshes.size() << " meshes" << std::endl;
 
     auto quad = buffer_quad();
+    FrameBench frame_bench;
 
     sr::Skybox skybox;
     skybox.load_from_dir(BASELINE_RESOURCE_DIR "/skybox");
@@ -106,56 +349,215 @@ auto main(void) -> int
     sr::Skybox hdr_skybox;
     hdr_skybox.load_from_hdr(BASELINE_RESOURCE_DIR "/hdr/skycloudy/HDR_029_Sky_Cloudy_Ref.hdr");
 
-    std::vector<IndexedGeom> buffers;
-    std::vector<u32> mat_idxs;
+    // every model mesh shares the arena's buffers and VAOs, the depth prepass
+    // only binds the position stream
+    sr::GeometryArena<sr::PackedVertex> geometry;
+    geometry.set_label("model geometry");
+    std::vector<sr::GeometryHandle> meshes;
+    std::vector<sm::Mat4> mesh_dequantize;
+    std::vector<DrawItem> draws;
+    std::vector<sr::PointLight> lights;
+    sr::StressScene stress_scene;
+
+    if (stress_mode)
+    {
+        if (stress_fox)
+        {
+            stress_scene = sr::StressSceneGenerator::generate(stress_config, fox);
+        }
+        else
+        {
+            stress_scene = sr::StressSceneGenerator::generate(stress_config);
+        }
 
-    for (auto& mesh : model.meshes)
+        u32 first = buffer_model(stress_scene.model, geometry, meshes, mesh_dequantize);
+        for (auto& instance : stress_scene.instances)
+        {
+            draws.push_back(DrawItem {
+                first + instance.mesh,
+                &stress_scene.model.materials[instance.material],
+                sm::to_mat4(instance.transform),
+                sm::normal_matrix(instance.transform),
+            });
+        }
+        lights = stress_scene.lights;
+
+        frame_bench.set_info("instances", stress_scene.instances.size());
+        frame_bench.set_info("unique_meshes", stress_scene.model.meshes.size());
+        frame_bench.set_info("materials", stress_scene.model.materials.size());
+        frame_bench.set_info("textures", stress_config.n_textures);
+        frame_bench.set_info("lights", lights.size());
+        frame_bench.set_info("geometry_bytes", stress_scene.geometry_bytes());
+        frame_bench.set_info("texture_bytes", stress_scene.texture_bytes);
+    }
+    else
     {
-        GLuint ebo;
+        auto model_to_world = sm::mat4_I();//sm::scale_by(sm::Vec3{50, 1, 50});
+        auto normal_to_world = sm::normal_matrix(model_to_world);
 
-        IndexedGeom geometry;
-        geometry.prim_type = GL_TRIANGLES;
+        u32 first = buffer_model(model, geometry, meshes, mesh_dequantize);
+        for (u32 i = 0; i < model.meshes.size(); i++)
+        {
+            auto material = &model.materials[model.meshes[i].material_index];
+            draws.push_back(DrawItem { first + i, material, model_to_world, normal_to_world });
+        }
 
-        geometry.vert_buf.buffer_data(mesh.verts.data(), mesh.verts.size());
-        geometry.vert_buf.bind_vao();
+        sm::Transform fox_transform = sm::transform_I();
+        fox_transform.translation = sm::Vec3{0, 1, 0};
+        auto fox_to_world = sm::to_mat4(fox_transform);
+        auto fox_normal_to_world = sm::normal_matrix(fox_transform);
 
-        geometry.index_buf.bind();
-        geometry.index_buf.buffer_indices(mesh.indices.data(), mesh.indices.size());
+        first = buffer_model(fox, geometry, meshes, mesh_dequantize);
+        for (u32 i = 0; i < fox.meshes.size(); i++)
+        {
+            auto material = &fox.materials[fox.meshes[i].material_index];
+            draws.push_back(DrawItem { first + i, material, fox_to_world, fox_normal_to_world });
+        }
 
-        geometry.vert_buf.unbind_vao();
-        buffers.push_back(geometry);
-        mat_idxs.push_back(mesh.material_index);
+        sm::Vec3 light_color = {4, 4, 3.4};
+        lights.push_back(sr::PointLight { sm::Vec3{2, 2, 2}, light_color });
+        lights.push_back(sr::PointLight { sm::Vec3{-2, 2, 2}, light_color });
+        lights.push_back(sr::PointLight { sm::Vec3{2, 2, -2}, light_color });
+        lights.push_back(sr::PointLight { sm::Vec3{-2, 2, -2}, light_color });
     }
 
-    u32 fox_start = buffers.size();
-    for (auto& mesh : fox.meshes)
-    {
-        GLuint ebo;
-
-        IndexedGeom geometry;
-        geometry.prim_type = GL_TRIANGLES;
-
-        geometry.vert_buf.buffer_data(mesh.verts.data(), mesh.verts.size());
-        geometry.vert_buf.bind_vao();
+    GLuint light_tex = buffer_lights(lights);
 
-        geometry.index_buf.bind();
-        geometry.index_buf.buffer_indices(mesh.indices.data(), mesh.indices.size());
+    // the light count is baked into the variants so the light loop is fixed
+    u32 light_features = lights.size() <= 0xff ? sr::shader_features_with_lights(sr::ShaderFeature_None, lights.size()) : 0;
+    std::vector<sr::Material*> materials;
+    for (auto& draw : draws)
+    {
+        // the vertices are quantized over their mesh's bounds
+        draw.model_to_world = draw.model_to_world * mesh_dequantize[draw.geometry];
+        draw.shader_features = light_features;
+        if (draw.material->normals.get_id() != 0)
+        {
+            draw.shader_features |= sr::ShaderFeature_NormalMap;
+        }
+        if (draw.material->alpha_test)
+        {
+            draw.shader_features |= sr::ShaderFeature_AlphaTest;
+        }
 
-        geometry.vert_buf.unbind_vao();
-        buffers.push_back(geometry);
-        mat_idxs.push_back(mesh.material_index);
+        auto it = std::find(materials.begin(), materials.end(), draw.material);
+        draw.material_id = it - materials.begin();
+        if (it == materials.end())
+        {
+            materials.push_back(draw.material);
+        }
     }
 
-    auto model_to_world = sm::mat4_I();//sm::scale_by(sm::Vec3{50, 1, 50});
+    // rebuilt every frame, front to back for the prepass and by state for
+    // the forward pass
+    sr::RenderQueue depth_queue(sr::SortKeyLayout::front_to_back());
+    sr::RenderQueue opaque_queue(sr::SortKeyLayout::state());
+    depth_queue.reserve(draws.size());
+    opaque_queue.reserve(draws.size());
+
+    // transforms and material parameters, uploaded once a frame and indexed
+    // by the draws
+    sr::DrawData draw_data;
+    draw_data.reserve(draws.size(), materials.size());
+    // commands for the next multi-draw, flushed whenever state changes
+    sr::IndirectDrawList indirect_draws;
+    indirect_draws.reserve(draws.size());
 
     // TODO: should have a flags param or something instead of true/false.
     sr::Framebuffer depth_buffer = sr::Framebuffer::create_framebuffer(1280, 720, 0, true, true);
     sr::Framebuffer render_buffer = sr::Framebuffer::create_framebuffer(1280, 720, 1, depth_buffer.get_depth_buffer(), true);
     sr::Framebuffer resolve_buffer = sr::Framebuffer::create_framebuffer(1280, 720, 1, true, false);
+    // render_buffer shares depth_buffer's depth, which keeps the later label
+    render_buffer.set_label("render_buffer");
+    depth_buffer.set_label("depth_buffer");
+    resolve_buffer.set_label("resolve_buffer");
+
+    if (sr::ProgramCache::enabled())
+    {
+        auto& cache = sr::ProgramCache::stats();
+        if (bench_mode)
+        {
+            frame_bench.set_info("shader_cache_hits", cache.hits);
+            frame_bench.set_info("shader_cache_misses", cache.misses);
+            frame_bench.set_info("shader_cache_saved_us", cache.saved_ms > 0 ? cache.saved_ms * 1000 : 0);
+        }
+        else
+        {
+            std::cout << "Shader cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+                      << cache.load_ms << "ms loading, " << cache.saved_ms << "ms saved" << std::endl;
+        }
+    }
+
+    if (bench_mode)
+    {
+        // measure the real shaders, not the fallback
+        for (auto& draw : draws)
+        {
+            pbr_variants.prewarm(draw.shader_features);
+        }
+        if (!pbr_variants.wait_all())
+        {
+            std::cout << "pbr" << std::endl;
+            return 1;
+        }
+        frame_bench.set_info("shader_variants", pbr_variants.n_variants());
+    }
+
+    // every pipeline the frame loop asks for, so none are made mid-frame
+    sr::PipelineCache::register_vertex_layout<sr::PackedVertex>();
+    sr::PipelineCache::register_vertex_layout<sr::PackedPositionOnly>();
+    sr::PipelineCache::register_vertex_layout<SimpleVertex>();
+
+    // the depth prepass reads positions only, the first of PackedVertex's streams
+    constexpr u32 DEPTH_STREAMS = sr::StreamInfo<sr::PackedPositionOnly>::COUNT;
+    sr::PipelineDesc depth_pipeline;
+    depth_pipeline.program = depth_prepass.get_id();
+    depth_pipeline.vertex_layout = sr::vertex_layout_key<sr::PackedPositionOnly>();
+    depth_pipeline.target = depth_buffer.get_format();
+
+    sr::PipelineDesc forward_pipeline;
+    forward_pipeline.vertex_layout = sr::vertex_layout_key<sr::PackedVertex>();
+    forward_pipeline.target = render_buffer.get_format();
+
+    sr::PipelineDesc blit_pipeline;
+    blit_pipeline.program = screen_shader.get_id();
+    blit_pipeline.vertex_layout = sr::vertex_layout_key<SimpleVertex>();
+    blit_pipeline.target = sr::Renderer::get_default_framebuffer()->get_format();
+
+    sr::PipelineCache::get(depth_pipeline);
+    for (auto& draw : draws)
+    {
+        // variants still compiling outside bench mode prewarm the fallback
+        forward_pipeline.program = pbr_variants.get(draw.shader_features).get_active_id();
+        sr::PipelineCache::get(forward_pipeline);
+    }
+    sr::PipelineCache::get(blit_pipeline);
+    sr::PipelineCache::prewarm();
+    if (bench_mode)
+    {
+        frame_bench.set_info("pipelines", sr::PipelineCache::n_pipelines());
+    }
+
+    if (alloc_guard && !sr::AllocTracker::enabled())
+    {
+        std::cout << "--alloc-guard needs a build with SPENNY_TRACK_ALLOCS" << std::endl;
+    }
 
-    i64 ticks = SDL_GetTicks();
-    i64 last_ticks = ticks;
-    while (running)
+    // The prewarm doesn't look exactly like the real draws, so the driver can
+    // still be compiling in the first frames. Bench mode draws frames until
+    // one goes by without a heap allocation (just one without
+    // SPENNY_TRACK_ALLOCS) before the bench and the allocation guard start.
+    const u32 MAX_PRIMING_FRAMES = 16;
+    u32 n_priming_frames = 0;
+    bool priming = bench_mode;
+    if (alloc_guard && !priming)
+    {
+        sr::AllocTracker::set_frame_guard(alloc_guard_warmup);
+    }
+
+    // the bench clock starts at zero, not at however long startup took
+    i64 last_ticks = bench_mode ? 0 : SDL_GetTicks();
+    while (running && !frame_bench.done())
     {
         while (SDL_PollEvent(&e))
         {
@@ -170,7 +572,8 @@ auto main(void) -> int
             }
         }
 
-        i64 ticks = SDL_GetTicks();
+        // bench mode steps a fixed 60Hz clock so every run sees the same frames
+        i64 ticks = bench_mode ? (frame_bench.frame_index() * 1000) / 60 : SDL_GetTicks();
         i64 ticks_delta = ticks - last_ticks;
 
         f32 time_s = ticks / 1000.0f;
@@ -182,75 +585,188 @@ auto main(void) -> int
         camera_pos_h = rot * camera_pos_h;
         sm::Vec3 camera_pos{ camera_pos_h.x, camera_pos_h.y, camera_pos_h.z };
 
+        pbr_variants.update();
+
+        sm::Vec3 camera_target{0, 2, 0};
         sr::Renderer::set_camera_position(camera_pos);
-        sr::Renderer::set_camera_target(sm::Vec3{0, 2, 0});
+        sr::Renderer::set_camera_target(camera_target);
 
+        frame_bench.begin_frame();
         sr::Renderer::begin_frame();
-        // depth prepass
-        depth_buffer.bind();
-        depth_buffer.clear(GL_DEPTH_BUFFER_BIT);
-        depth_prepass.use_program();
-        depth_prepass.set_uniform_mat4("model_to_world", model_to_world);
-        for (u32 i = 0; i < buffers.size(); i++)
+
+        {
+            SR_PROFILE_SCOPE("build_draw_data");
+            draw_data.clear();
+            for (auto* material : materials)
+            {
+                draw_data.push_material(*material);
+            }
+            for (auto& draw : draws)
+            {
+                draw_data.push_object(draw.model_to_world, draw.normal_to_world, draw.material_id);
+            }
+            draw_data.upload(sr::Renderer::get_upload_ring());
+        }
+
         {
-            if (i >= fox_start)
+            SR_PROFILE_SCOPE("build_queues");
+            // depth of each mesh's bounds centre along the view direction,
+            // model_to_world takes [0, 1] across the bounds
+            sm::Vec3 view_dir = sm::norm(camera_target - camera_pos);
+            depth_queue.clear();
+            opaque_queue.clear();
+            for (u32 i = 0; i < draws.size(); i++)
             {
-                depth_prepass.set_uniform_mat4("model_to_world", sm::translation_by(sm::Vec3{0, 1, 0}));
+                auto& draw = draws[i];
+                sm::Vec4 centre = draw.model_to_world * sm::Vec4{0.5, 0.5, 0.5, 1};
+                f32 depth = sm::dot(sm::Vec3{centre.x, centre.y, centre.z} - camera_pos, view_dir);
+                u32 program = pbr_variants.get(draw.shader_features).get_id();
+                // the prepass doesn't discard, it would fill in the holes
+                if (!(draw.shader_features & sr::ShaderFeature_AlphaTest))
+                {
+                    depth_queue.push(sr::DrawPacket{ depth_prepass.get_id(), draw.material_id, draw.geometry, i, depth });
+                }
+                opaque_queue.push(sr::DrawPacket{ program, draw.material_id, draw.geometry, i, depth });
             }
-            sr::Renderer::draw_indexed_geom(buffers[i]);
+            depth_queue.sort();
+            opaque_queue.sort();
+        }
+
+        // depth prepass
+        {
+            FrameBench::Pass pass(frame_bench, "depth_prepass");
+            depth_buffer.bind();
+            depth_buffer.clear(GL_DEPTH_BUFFER_BIT);
+            sr::PipelineCache::get(depth_pipeline).bind();
+            depth_queue.submit([&](const sr::DrawPacket& packet) {
+                if (direct_draws)
+                {
+                    sr::Renderer::draw_indexed_geom(geometry, meshes[packet.geometry], packet.object, DEPTH_STREAMS);
+                }
+                else
+                {
+                    indirect_draws.push(geometry.get(meshes[packet.geometry]), packet.object);
+                }
+            });
+            sr::Renderer::multi_draw_indexed_geom(geometry, indirect_draws, DEPTH_STREAMS);
+            depth_buffer.unbind();
         }
-        depth_buffer.unbind();
 
         // render pass
-        render_buffer.bind();
+        {
+            FrameBench::Pass pass(frame_bench, "forward");
+            render_buffer.bind();
 
-        sr::Renderer::set_clear_color(sm::Vec4{0.071, 0.071, 0.071, 1.0});
-        render_buffer.clear(GL_COLOR_BUFFER_BIT);
+            sr::Renderer::set_clear_color(sm::Vec4{0.071, 0.071, 0.071, 1.0});
+            render_buffer.clear(GL_COLOR_BUFFER_BIT);
 
-        shader.use_program();
-        shader.set_uniform_mat4("model_to_world", model_to_world);
-        shader.set_uniform_int("texture", 0);
-        shader.set_uniform_int("normals", 1);
+            sr::GLState::bind_texture(GL_TEXTURE2, GL_TEXTURE_BUFFER, light_tex);
 
-        for (u32 i = 0; i < buffers.size(); i++)
-        {
-            sr::Material mat;
-            if (i >= fox_start)
-            {
-                mat = fox.materials[mat_idxs[i]];
-                shader.set_uniform_mat4("model_to_world", sm::translation_by(sm::Vec3{0, 1, 0}));
-            }
-            else
-            {
-                mat = model.materials[mat_idxs[i]];
-            }
-            auto diffuse = mat.diffuse;
-            auto normals = mat.normals;
+            sr::Shader* pbr = nullptr;
+            sr::Material* bound_material = nullptr;
+            opaque_queue.submit([&](const sr::DrawPacket& packet) {
+                auto& draw = draws[packet.object];
+                auto& mat = *draw.material;
 
-            sr::Renderer::use_material(mat);
+                auto& variant = pbr_variants.get(draw.shader_features);
+                if (&variant != pbr)
+                {
+                    sr::Renderer::multi_draw_indexed_geom(geometry, indirect_draws);
+                    pbr = &variant;
+                    forward_pipeline.program = pbr->get_active_id();
+                    sr::PipelineCache::get(forward_pipeline).bind();
+                    pbr->set_uniform_int("n_lights", lights.size());
+                }
+
+                // the queue keeps draws of a material together
+                if (&mat != bound_material)
+                {
+                    sr::Renderer::multi_draw_indexed_geom(geometry, indirect_draws);
+                    bound_material = &mat;
+                    mat.diffuse.bind_texture(GL_TEXTURE0);
+                    mat.normals.bind_texture(GL_TEXTURE1);
+                }
 
-            diffuse.bind_texture(GL_TEXTURE0);
-            normals.bind_texture(GL_TEXTURE1);
+                if (direct_draws)
+                {
+                    sr::Renderer::draw_indexed_geom(geometry, meshes[draw.geometry], packet.object);
+                }
+                else
+                {
+                    indirect_draws.push(geometry.get(meshes[draw.geometry]), packet.object);
+                }
+            });
+            sr::Renderer::multi_draw_indexed_geom(geometry, indirect_draws);
+        }
 
-            sr::Renderer::draw_indexed_geom(buffers[i]);
+        {
+            FrameBench::Pass pass(frame_bench, "skybox");
+            hdr_skybox.render();
+            render_buffer.unbind();
+        }
+
+        {
+            FrameBench::Pass pass(frame_bench, "resolve");
+            render_buffer.resolve_to(resolve_buffer);
         }
 
-        hdr_skybox.render();
+        {
+            FrameBench::Pass pass(frame_bench, "blit");
+            sr::Renderer::get_default_framebuffer()->bind();
 
-        render_buffer.unbind();
+            resolve_buffer.get_color_attachment(0).bind_texture(GL_TEXTURE0);
+            sr::PipelineCache::get(blit_pipeline).bind();
+            screen_shader.set_uniform_int("scene", 0);
 
-        render_buffer.resolve_to(resolve_buffer);
+            sr::Renderer::draw_indexed_geom(quad);
+        }
 
-        sr::Renderer::get_default_framebuffer()->bind();
+        sr::Renderer::end_frame();
+        frame_bench.end_frame();
 
-        resolve_buffer.get_color_attachment(0).bind_texture(GL_TEXTURE0);
-        screen_shader.use_program();
-        screen_shader.set_uniform_int("scene", GL_TEXTURE0);
+        if (priming && (sr::AllocTracker::last_frame().allocs == 0 || ++n_priming_frames == MAX_PRIMING_FRAMES))
+        {
+            priming = false;
+            frame_bench.start(bench_frames, bench_warmup);
+            if (alloc_guard)
+            {
+                sr::AllocTracker::set_frame_guard(alloc_guard_warmup);
+            }
+        }
+    }
 
-        sr::Renderer::draw_indexed_geom(quad);
+    if (bench_mode)
+    {
+        if (bench_out.empty())
+        {
+            frame_bench.write_json(std::cout);
+        }
+        else
+        {
+            std::ofstream out(bench_out);
+            frame_bench.write_json(out);
+        }
+    }
 
-        sr::Renderer::end_frame();
+    if (!shader_manifest.empty())
+    {
+        pbr_variants.write_manifest(shader_manifest);
+    }
 
+    auto& late_pipelines = sr::PipelineCache::late_pipelines();
+    if (!late_pipelines.empty())
+    {
+        std::cout << late_pipelines.size() << " pipelines were first used mid-frame:" << std::endl;
+        for (auto& late : late_pipelines)
+        {
+            std::cout << "  frame " << late.frame << ": program " << late.desc.program
+                      << ", pipeline " << std::hex << late.hash << std::dec << std::endl;
+        }
+    }
+
+    if (!trace_out.empty())
+    {
+        sr::Profiler::write_chrome_trace(trace_out, trace_frames);
     }
 
     sr::Renderer::end();
@@ -0,0 +1,84 @@
+#ifndef SPENNY_BENCH_H
+#define SPENNY_BENCH_H
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "spennytypes.h"
+
+namespace bench
+{
+
+struct Config
+{
+    u32 warmup = 3;
+    u32 reps = 20;
+    // only run benchmarks whose name contains this
+    std::string filter;
+};
+
+struct Result
+{
+    std::string name;
+    u32 reps;
+    // work items per rep, e.g. matrices multiplied. Used for per-item times.
+    u64 items;
+    f64 min_ns;
+    f64 median_ns;
+    f64 p99_ns;
+    f64 mean_ns;
+};
+
+struct Check
+{
+    std::string name;
+    bool passed;
+    f64 max_error;
+};
+
+// Keeps the compiler from throwing away a result that is never read.
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Harness
+{
+public:
+    explicit Harness(Config config) : config(config) {}
+
+    // Runs fn config.warmup times untimed, then config.reps times timed.
+    void run(const std::string& name, u64 items, const std::function<void()>& fn);
+
+    // Records a correctness check, e.g. a SIMD kernel against its
+    // scalar reference. Failed checks make the bench exit non-zero.
+    void check(const std::string& name, f64 max_error, f64 tolerance);
+
+    bool all_checks_passed() const;
+    bool wants(const std::string& name) const;
+
+    void write_json(std::ostream& os) const;
+
+    const Config& get_config() const { return config; }
+
+private:
+    Config config;
+    std::vector<Result> results;
+    std::vector<Check> checks;
+};
+
+// One per source file, each registers and runs its own benchmarks.
+void bench_math(Harness& harness);
+void bench_assets(Harness& harness);
+void bench_scene(Harness& harness);
+void bench_geometry(Harness& harness);
+void bench_vertpack(Harness& harness);
+void bench_renderqueue(Harness& harness);
+
+} // namespace bench
+
+#endif // SPENNY_BENCH_H
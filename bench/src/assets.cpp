@@ -0,0 +1,96 @@
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <stb_image.h>
+
+#include "bench.h"
+#include "model.h"
+
+#ifndef BENCH_RESOURCE_DIR
+#define BENCH_RESOURCE_DIR "./baseline/resource/"
+#endif
+
+namespace bench
+{
+
+static std::vector<u8> read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<u8>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void bench_model(Harness& harness, const std::string& name, const std::string& path)
+{
+    std::string bench_name = "assets/import/" + name;
+    if (!harness.wants(bench_name))
+    {
+        return;
+    }
+
+    sr::ModelLoader loader;
+    // count vertices once so results can be compared per vertex
+    auto model = loader.load_from_file(path, sr::ModelLoadFlags_NoTextures);
+    if (!model)
+    {
+        std::cerr << "couldn't load " << path << ", skipping" << std::endl;
+        return;
+    }
+    u64 n_verts = 0;
+    for (auto& mesh : model->meshes)
+    {
+        n_verts += mesh.verts.size();
+    }
+
+    harness.run(bench_name, n_verts, [&]
+    {
+        auto m = loader.load_from_file(path, sr::ModelLoadFlags_NoTextures);
+        do_not_optimize(m);
+    });
+}
+
+static void bench_decode(Harness& harness, const std::string& name, const std::string& path, bool hdr)
+{
+    std::string bench_name = "assets/decode/" + name;
+    if (!harness.wants(bench_name))
+    {
+        return;
+    }
+
+    // decode from memory so disk IO isn't part of the measurement
+    auto bytes = read_file(path);
+    if (bytes.empty())
+    {
+        std::cerr << "couldn't read " << path << ", skipping" << std::endl;
+        return;
+    }
+
+    int w, h, c;
+    if (!stbi_info_from_memory(bytes.data(), bytes.size(), &w, &h, &c))
+    {
+        std::cerr << "couldn't decode " << path << ": " << stbi_failure_reason() << std::endl;
+        return;
+    }
+
+    harness.run(bench_name, (u64)w * h, [&]
+    {
+        int w, h, c;
+        void* data = hdr
+            ? (void*)stbi_loadf_from_memory(bytes.data(), bytes.size(), &w, &h, &c, 0)
+            : (void*)stbi_load_from_memory(bytes.data(), bytes.size(), &w, &h, &c, 4);
+        do_not_optimize(data);
+        stbi_image_free(data);
+    });
+}
+
+void bench_assets(Harness& harness)
+{
+    bench_model(harness, "fox", BENCH_RESOURCE_DIR "/fox/fox.glb");
+    bench_model(harness, "testlevel", BENCH_RESOURCE_DIR "/testarena/testlevel.glb");
+
+    bench_decode(harness, "fox_diffuse_png", BENCH_RESOURCE_DIR "/fox/Textures/fox_diffuse.png", false);
+    bench_decode(harness, "fox_normal_png", BENCH_RESOURCE_DIR "/fox/Textures/Fox_Normal.png", false);
+    bench_decode(harness, "skybox_jpg", BENCH_RESOURCE_DIR "/skybox/front.jpg", false);
+    bench_decode(harness, "sky_cloudy_hdr", BENCH_RESOURCE_DIR "/hdr/skycloudy/HDR_029_Sky_Cloudy_Env.hdr", true);
+}
+
+} // namespace bench
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <glad/glad.h>
+
+#include "bench.h"
+#include "geomarena.h"
+#include "renderer.h"
+
+namespace bench
+{
+
+// Two streams, so the checks also cover gathering split streams. Every
+// vertex carries its own id, a vertex that ends up in the wrong place can't
+// match by accident.
+struct TestPos
+{
+    using Layout = sr::BufferLayout<sr::F32Component<3>>;
+
+    sm::Vec3 pos;
+};
+
+struct TestId
+{
+    using Layout = sr::BufferLayout<sr::U32Component<1>>;
+
+    u32 id;
+};
+
+using TestArena = sr::GeometryArena<sr::VertexStreams<TestPos, TestId>>;
+
+struct SourceMesh
+{
+    std::vector<TestPos> pos;
+    std::vector<TestId> ids;
+    std::vector<u32> indices;
+};
+
+// n by n vertices, two triangles a cell, ids from first_id up
+static SourceMesh make_grid(u32 n, u32 first_id)
+{
+    SourceMesh mesh;
+    for (u32 y = 0; y < n; y++)
+    {
+        for (u32 x = 0; x < n; x++)
+        {
+            mesh.pos.push_back(TestPos{ sm::Vec3{ (f32)x, (f32)y, 0 } });
+            mesh.ids.push_back(TestId{ first_id + y * n + x });
+        }
+    }
+    for (u32 y = 0; y + 1 < n; y++)
+    {
+        for (u32 x = 0; x + 1 < n; x++)
+        {
+            u32 v = y * n + x;
+            mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + n, v + 1, v + n + 1, v + n });
+        }
+    }
+    return mesh;
+}
+
+static sr::GeometryHandle add(TestArena& arena, const SourceMesh& mesh)
+{
+    return arena.add(mesh.pos.size(), mesh.indices.data(), mesh.indices.size(), mesh.pos.data(), mesh.ids.data());
+}
+
+template<typename T>
+static std::vector<T> read_buffer(GLuint buffer, u32 count)
+{
+    std::vector<T> data(count);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (std::size_t)count * sizeof(T), data.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return data;
+}
+
+// Everything in the arena's buffers, read back once for checking many meshes
+struct ArenaContents
+{
+    explicit ArenaContents(const TestArena& arena)
+        : pos(read_buffer<TestPos>(arena.get_vertex_buffer(0), arena.get_vertex_capacity()))
+        , ids(read_buffer<TestId>(arena.get_vertex_buffer(1), arena.get_vertex_capacity()))
+        , indices(read_buffer<TestArena::Index>(arena.get_index_buffer(), arena.get_index_capacity()))
+    {
+    }
+
+    std::vector<TestPos> pos;
+    std::vector<TestId> ids;
+    std::vector<TestArena::Index> indices;
+};
+
+// Indices of the mesh, as drawn from the arena, that don't reach the same
+// vertex as in the source. Parts over 16 bit indices count as wrong too.
+static u64 count_mismatches(const ArenaContents& contents, const TestArena& arena, sr::GeometryHandle handle,
+                            const SourceMesh& mesh)
+{
+    u64 bad = 0;
+    u32 n_indices = 0;
+    auto& parts = arena.get(handle);
+    for (auto& part : parts)
+    {
+        bad += part.n_verts > sr::MAX_U16_INDEXED_VERTS;
+        for (u32 i = 0; i < part.n_indices; i++)
+        {
+            // parts keep the source's index order, back to back
+            u32 want = mesh.indices[part.first_index - parts.front().first_index + i];
+            u32 local = contents.indices[part.first_index + i];
+            u32 vert = part.base_vertex + local;
+            bool same = local < part.n_verts
+                        && contents.ids[vert].id == mesh.ids[want].id
+                        && contents.pos[vert].pos == mesh.pos[want].pos;
+            bad += !same;
+        }
+        n_indices += part.n_indices;
+    }
+    return bad + (n_indices != mesh.indices.size());
+}
+
+static u64 count_mismatches(const TestArena& arena, const std::vector<sr::GeometryHandle>& handles,
+                            const std::vector<SourceMesh>& meshes, const std::vector<bool>& live)
+{
+    ArenaContents contents(arena);
+    u64 bad = 0;
+    for (u32 i = 0; i < handles.size(); i++)
+    {
+        if (live[i])
+        {
+            bad += count_mismatches(contents, arena, handles[i], meshes[i]);
+        }
+    }
+    return bad;
+}
+
+// Small meshes into a small arena: freeing three neighbours has to leave one
+// block a bigger mesh fits in, a mesh that doesn't fit anywhere grows the
+// buffers, and compacting packs what's left at the start. Everything still
+// live is read back after each step.
+static void check_arena_reuse(Harness& harness)
+{
+    TestArena arena(256, 1024);
+    std::vector<SourceMesh> meshes;
+    std::vector<sr::GeometryHandle> handles;
+    std::vector<bool> live;
+    auto add_mesh = [&](u32 n)
+    {
+        meshes.push_back(make_grid(n, meshes.size() * 1000));
+        handles.push_back(add(arena, meshes.back()));
+        live.push_back(true);
+        return arena.get(handles.back()).front();
+    };
+    auto free_mesh = [&](u32 i)
+    {
+        arena.free(handles[i]);
+        live[i] = false;
+    };
+
+    // 16 vertices and 54 indices each
+    for (u32 i = 0; i < 8; i++)
+    {
+        add_mesh(4);
+    }
+    sr::GeometryRange hole = arena.get(handles[2]).front();
+    free_mesh(3);
+    free_mesh(2);
+    free_mesh(4);
+
+    // 36 vertices and 150 indices, only fits if the three holes merged
+    sr::GeometryRange merged = add_mesh(6);
+    u64 bad = merged.base_vertex != hole.base_vertex || merged.first_index != hole.first_index;
+    harness.check("geometry/arena/merged", bad + count_mismatches(arena, handles, meshes, live), 0);
+
+    // 144 vertices and 726 indices, more than is left of either
+    u32 vertex_capacity = arena.get_vertex_capacity();
+    u32 index_capacity = arena.get_index_capacity();
+    add_mesh(12);
+    bad = arena.get_vertex_capacity() <= vertex_capacity || arena.get_index_capacity() <= index_capacity;
+    harness.check("geometry/arena/grown", bad + count_mismatches(arena, handles, meshes, live), 0);
+
+    free_mesh(0);
+    free_mesh(6);
+    arena.compact();
+    u32 vertex_end = 0;
+    u32 index_end = 0;
+    for (u32 i = 0; i < handles.size(); i++)
+    {
+        if (live[i])
+        {
+            auto& range = arena.get(handles[i]).front();
+            vertex_end = std::max(vertex_end, range.base_vertex + range.n_verts);
+            index_end = std::max(index_end, range.first_index + range.n_indices);
+        }
+    }
+    bad = vertex_end != arena.get_used_vertices() || index_end != arena.get_used_indices();
+    harness.check("geometry/arena/compacted", bad + count_mismatches(arena, handles, meshes, live), 0);
+}
+
+// A grid too big for 16 bit indices between two small meshes: it has to be
+// split, survive the small meshes around it being freed and the arena being
+// compacted, and come back out as the same triangles every time.
+static void check_split_mesh(Harness& harness)
+{
+    TestArena arena;
+    SourceMesh before = make_grid(4, 0);
+    SourceMesh grid = make_grid(301, 1000);
+    SourceMesh after = make_grid(5, 200000);
+
+    auto before_handle = add(arena, before);
+    auto grid_handle = add(arena, grid);
+    auto after_handle = add(arena, after);
+
+    u64 bad = count_mismatches(ArenaContents(arena), arena, grid_handle, grid);
+    harness.check("geometry/split/pieces", arena.get(grid_handle).size() > 1 ? 0 : 1, 0);
+    harness.check("geometry/split/readback", bad, 0);
+
+    arena.free(before_handle);
+    arena.free(after_handle);
+    arena.compact();
+    bad = count_mismatches(ArenaContents(arena), arena, grid_handle, grid);
+    harness.check("geometry/split/compacted", bad + (arena.get(grid_handle).front().base_vertex != 0), 0);
+
+    // back into the space the small meshes left
+    before_handle = add(arena, before);
+    after_handle = add(arena, after);
+    ArenaContents contents(arena);
+    bad = count_mismatches(contents, arena, grid_handle, grid)
+          + count_mismatches(contents, arena, before_handle, before)
+          + count_mismatches(contents, arena, after_handle, after);
+    harness.check("geometry/split/reused", bad, 0);
+}
+
+void bench_geometry(Harness& harness)
+{
+    // the checks need a GL context as well, they run with the benchmark
+    const std::string bench_name = "geometry/add_split_grid";
+    if (!harness.wants(bench_name))
+    {
+        return;
+    }
+    if (!sr::Renderer::start("spennyrender_bench", 64, 64, sr::RendererFlags_Headless))
+    {
+        std::cerr << "No GL context, skipping the geometry benchmarks" << std::endl;
+        return;
+    }
+
+    check_split_mesh(harness);
+    check_arena_reuse(harness);
+
+    SourceMesh grid = make_grid(301, 0);
+    TestArena arena;
+    harness.run(bench_name, grid.pos.size(), [&]
+    {
+        arena.free(add(arena, grid));
+    });
+
+    sr::Renderer::end();
+}
+
+} // namespace bench
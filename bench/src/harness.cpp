@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+
+#include "bench.h"
+
+namespace bench
+{
+
+using Clock = std::chrono::steady_clock;
+
+void Harness::run(const std::string& name, u64 items, const std::function<void()>& fn)
+{
+    if (!wants(name))
+    {
+        return;
+    }
+
+    for (u32 i = 0; i < config.warmup; i++)
+    {
+        fn();
+    }
+
+    std::vector<f64> samples;
+    samples.reserve(config.reps);
+    for (u32 i = 0; i < config.reps; i++)
+    {
+        auto start = Clock::now();
+        fn();
+        auto end = Clock::now();
+        samples.push_back(std::chrono::duration<f64, std::nano>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    f64 sum = 0;
+    for (auto s : samples)
+    {
+        sum += s;
+    }
+
+    // nearest-rank percentiles
+    auto percentile = [&](f64 p)
+    {
+        usize rank = (usize)std::ceil(p * samples.size());
+        return samples[std::clamp<usize>(rank, 1, samples.size()) - 1];
+    };
+
+    Result result;
+    result.name = name;
+    result.reps = config.reps;
+    result.items = items;
+    result.min_ns = samples.front();
+    result.median_ns = percentile(0.5);
+    result.p99_ns = percentile(0.99);
+    result.mean_ns = sum / samples.size();
+    results.push_back(result);
+
+    std::cerr << name << ": median " << result.median_ns / 1000.0 << "us"
+              << " (min " << result.min_ns / 1000.0 << "us, p99 " << result.p99_ns / 1000.0 << "us)"
+              << std::endl;
+}
+
+void Harness::check(const std::string& name, f64 max_error, f64 tolerance)
+{
+    bool passed = max_error <= tolerance;
+    checks.push_back(Check { name, passed, max_error });
+    if (!passed)
+    {
+        std::cerr << "CHECK FAILED " << name << ": max error " << max_error
+                  << " > " << tolerance << std::endl;
+    }
+}
+
+bool Harness::all_checks_passed() const
+{
+    return std::all_of(checks.begin(), checks.end(), [](const Check& c) { return c.passed; });
+}
+
+bool Harness::wants(const std::string& name) const
+{
+    return config.filter.empty() || name.find(config.filter) != std::string::npos;
+}
+
+void Harness::write_json(std::ostream& os) const
+{
+    os << "{\n";
+    os << "  \"warmup\": " << config.warmup << ",\n";
+    os << "  \"reps\": " << config.reps << ",\n";
+
+    os << "  \"benchmarks\": [";
+    for (usize i = 0; i < results.size(); i++)
+    {
+        auto& r = results[i];
+        os << (i ? ",\n" : "\n")
+           << "    {\"name\": \"" << r.name << "\""
+           << ", \"reps\": " << r.reps
+           << ", \"items\": " << r.items
+           << ", \"min_ns\": " << r.min_ns
+           << ", \"median_ns\": " << r.median_ns
+           << ", \"p99_ns\": " << r.p99_ns
+           << ", \"mean_ns\": " << r.mean_ns
+           << ", \"median_ns_per_item\": " << r.median_ns / std::max<u64>(r.items, 1)
+           << "}";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"checks\": [";
+    for (usize i = 0; i < checks.size(); i++)
+    {
+        auto& c = checks[i];
+        os << (i ? ",\n" : "\n")
+           << "    {\"name\": \"" << c.name << "\""
+           << ", \"passed\": " << (c.passed ? "true" : "false")
+           << ", \"max_error\": " << c.max_error
+           << "}";
+    }
+    os << "\n  ]\n";
+    os << "}" << std::endl;
+}
+
+} // namespace bench
@@ -0,0 +1,77 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+
+static void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " [options]\n"
+              << "  --warmup N      untimed runs before measuring (default 3)\n"
+              << "  --reps N        timed runs per benchmark (default 20)\n"
+              << "  --filter STR    only run benchmarks whose name contains STR\n"
+              << "  --out PATH      write JSON results to PATH instead of stdout\n";
+}
+
+auto main(int argc, char** argv) -> int
+{
+    bench::Config config;
+    std::string out_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--warmup") && has_value)
+        {
+            config.warmup = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--reps") && has_value)
+        {
+            config.reps = std::stoul(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--filter") && has_value)
+        {
+            config.filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--out") && has_value)
+        {
+            out_path = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.reps == 0)
+    {
+        std::cerr << "--reps must be at least 1" << std::endl;
+        return 1;
+    }
+
+    bench::Harness harness(config);
+
+    bench::bench_math(harness);
+    // spennyrender_bench_avx2 only has the math
+#ifndef BENCH_MATH_ONLY
+    bench::bench_scene(harness);
+    bench::bench_renderqueue(harness);
+    bench::bench_assets(harness);
+    bench::bench_vertpack(harness);
+    bench::bench_geometry(harness);
+#endif
+
+    if (out_path.empty())
+    {
+        harness.write_json(std::cout);
+    }
+    else
+    {
+        std::ofstream out(out_path);
+        harness.write_json(out);
+    }
+
+    return harness.all_checks_passed() ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "spennymath.h"
+#include "spennymath_batch.h"
+
+namespace bench
+{
+
+static f64 max_error(const sm::Mat4& a, const sm::Mat4& b)
+{
+    f64 err = 0;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            err = std::max<f64>(err, std::fabs(a.cols[col].xyzw[row] - b.cols[col].xyzw[row]));
+        }
+    }
+    return err;
+}
+
+static f64 max_error(const sm::Vec4& a, const sm::Vec4& b)
+{
+    f64 err = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        err = std::max<f64>(err, std::fabs(a.xyzw[i] - b.xyzw[i]));
+    }
+    return err;
+}
+
+static void check_simd_parity(Harness& harness, std::mt19937& rng)
+{
+    std::uniform_real_distribution<f32> dist(-2.0f, 2.0f);
+    std::uniform_real_distribution<f32> angle(-180.0f, 180.0f);
+
+    f64 mul_err = 0, vec_err = 0, transpose_err = 0, rotate_err = 0, look_at_err = 0;
+    for (u32 i = 0; i < 10000; i++)
+    {
+        sm::Mat4 a, b;
+        for (int col = 0; col < 4; col++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                a.cols[col].xyzw[row] = dist(rng);
+                b.cols[col].xyzw[row] = dist(rng);
+            }
+        }
+        sm::Vec4 v = { dist(rng), dist(rng), dist(rng), dist(rng) };
+        f32 pitch = angle(rng), yaw = angle(rng), roll = angle(rng);
+        sm::Vec3 pos = { dist(rng), dist(rng), dist(rng) };
+        sm::Vec3 target = { dist(rng), dist(rng), dist(rng) };
+
+        mul_err = std::max(mul_err, max_error(a * b, sm::scalar::mul(a, b)));
+        vec_err = std::max(vec_err, max_error(a * v, sm::scalar::mul(a, v)));
+        transpose_err = std::max(transpose_err, max_error(sm::transpose(a), sm::scalar::transpose(a)));
+        rotate_err = std::max(rotate_err, max_error(sm::rotate(pitch, yaw, roll), sm::scalar::rotate(pitch, yaw, roll)));
+        look_at_err = std::max(look_at_err, max_error(sm::look_at(pos, target), sm::scalar::look_at(pos, target)));
+    }
+
+    // FMA rounds once instead of twice, so allow a few ulps on values ~4
+    const f64 tolerance = 1e-5;
+    harness.check("math/parity/mat4_mul", mul_err, tolerance);
+    harness.check("math/parity/mat4_vec4", vec_err, tolerance);
+    harness.check("math/parity/transpose", transpose_err, 0);
+    harness.check("math/parity/rotate", rotate_err, tolerance);
+    harness.check("math/parity/look_at", look_at_err, tolerance);
+
+    // Both paths can share a mistake, e.g. a transposed product, so check
+    // them against a product worked out by hand too. Every value is exact.
+    sm::Mat4 t = sm::translation_by(sm::Vec3{1, 2, 3});
+    sm::Mat4 s = sm::scale_by(sm::Vec3{2, 3, 4});
+    // scale first, the translation is untouched
+    sm::Mat4 ts = {{ {2, 0, 0, 0}, {0, 3, 0, 0}, {0, 0, 4, 0}, {1, 2, 3, 1} }};
+    // translate first, the translation gets scaled
+    sm::Mat4 st = {{ {2, 0, 0, 0}, {0, 3, 0, 0}, {0, 0, 4, 0}, {2, 6, 12, 1} }};
+    sm::Vec4 v = {1, 1, 1, 1};
+    sm::Vec4 ts_v = {3, 5, 7, 1};
+
+    f64 known_mul_err = std::max({ max_error(t * s, ts), max_error(s * t, st),
+                                   max_error(sm::scalar::mul(t, s), ts), max_error(sm::scalar::mul(s, t), st) });
+    f64 known_vec_err = std::max(max_error(ts * v, ts_v), max_error(sm::scalar::mul(ts, v), ts_v));
+    harness.check("math/known/mat4_mul", known_mul_err, 0);
+    harness.check("math/known/mat4_vec4", known_vec_err, 0);
+}
+
+// The affine, quaternion and transform helpers against what they're
+// equivalent to, built from the checked matrix functions above
+static void check_affine_and_quat(Harness& harness, std::mt19937& rng)
+{
+    std::uniform_real_distribution<f32> dist(-2.0f, 2.0f);
+    std::uniform_real_distribution<f32> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<f32> scale(0.5f, 2.0f);
+
+    f64 inverse_err = 0, normal_err = 0, quat_err = 0, slerp_err = 0, compose_err = 0;
+    for (u32 i = 0; i < 10000; i++)
+    {
+        f32 pitch = angle(rng), yaw = angle(rng), roll = angle(rng);
+        sm::Vec3 pos = { dist(rng), dist(rng), dist(rng) };
+        sm::Vec3 s = { scale(rng), scale(rng), scale(rng) };
+        sm::Mat4 m = sm::translation_by(pos) * sm::rotate(pitch, yaw, roll) * sm::scale_by(s);
+
+        sm::Mat4 inv = sm::affine_inverse(m);
+        inverse_err = std::max(inverse_err, max_error(inv * m, sm::mat4_I()));
+
+        // transpose(inverse) with the translation that ends up in the bottom
+        // row dropped, normal_matrix pads with zeros there
+        sm::Mat4 inv_t = sm::transpose(inv);
+        inv_t.cols[0].w = inv_t.cols[1].w = inv_t.cols[2].w = 0;
+        normal_err = std::max(normal_err, max_error(sm::normal_matrix(m), inv_t));
+
+        sm::Quat q = sm::quat_euler(pitch, yaw, roll);
+        quat_err = std::max(quat_err, max_error(sm::to_mat4(q), sm::rotate(pitch, yaw, roll)));
+        sm::Transform t = { pos, q, s };
+        normal_err = std::max(normal_err, max_error(sm::normal_matrix(t), sm::normal_matrix(sm::to_mat4(t))));
+
+        // the endpoints, and halfway along a single axis is half the angle
+        sm::Quat b = sm::quat_euler(angle(rng), angle(rng), angle(rng));
+        sm::Vec3 axis = { dist(rng), dist(rng), dist(rng) + 3.0f };
+        f32 theta = angle(rng);
+        slerp_err = std::max(slerp_err, max_error(sm::to_mat4(sm::slerp(q, b, 0)), sm::to_mat4(q)));
+        slerp_err = std::max(slerp_err, max_error(sm::to_mat4(sm::slerp(q, b, 1)), sm::to_mat4(b)));
+        slerp_err = std::max(slerp_err, max_error(sm::to_mat4(sm::slerp(sm::quat_I(), sm::quat_axis_angle(axis, theta), 0.5f)),
+                                                  sm::to_mat4(sm::quat_axis_angle(axis, theta / 2))));
+
+        // composition is only exact with uniform scale
+        f32 sa = scale(rng), sb = scale(rng);
+        sm::Transform ta = { pos, q, { sa, sa, sa } };
+        sm::Transform tb = { { dist(rng), dist(rng), dist(rng) }, b, { sb, sb, sb } };
+        compose_err = std::max(compose_err, max_error(sm::to_mat4(ta * tb), sm::to_mat4(ta) * sm::to_mat4(tb)));
+    }
+
+    const f64 tolerance = 1e-5;
+    harness.check("math/affine/inverse", inverse_err, tolerance);
+    harness.check("math/affine/normal_matrix", normal_err, tolerance);
+    harness.check("math/quat/to_mat4", quat_err, tolerance);
+    harness.check("math/quat/slerp", slerp_err, tolerance);
+    harness.check("math/transform/compose", compose_err, tolerance);
+}
+
+static void check_batch_parity(Harness& harness, const std::vector<sm::Vec3x8>& points, const sm::Mat4& m)
+{
+    std::vector<sm::Vec3x8> simd_out(points.size());
+    std::vector<sm::Vec3x8> scalar_out(points.size());
+    sm::transform_points(m, points, simd_out);
+    sm::scalar::transform(m, points, scalar_out, 1.0f);
+
+    f64 err = 0;
+    for (usize block = 0; block < points.size(); block++)
+    {
+        for (usize lane = 0; lane < sm::BATCH_LANES; lane++)
+        {
+            err = std::max<f64>(err, std::fabs(simd_out[block].x[lane] - scalar_out[block].x[lane]));
+            err = std::max<f64>(err, std::fabs(simd_out[block].y[lane] - scalar_out[block].y[lane]));
+            err = std::max<f64>(err, std::fabs(simd_out[block].z[lane] - scalar_out[block].z[lane]));
+        }
+    }
+    harness.check("math/parity/transform_points", err, 1e-4);
+}
+
+void bench_math(Harness& harness)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<f32> dist(-2.0f, 2.0f);
+
+    check_simd_parity(harness, rng);
+    check_affine_and_quat(harness, rng);
+
+    const u32 N_MATS = 4096;
+    std::vector<sm::Mat4> lhs(N_MATS), rhs(N_MATS), out(N_MATS);
+    std::vector<sm::Vec4> vecs(N_MATS), vec_out(N_MATS);
+    for (u32 i = 0; i < N_MATS; i++)
+    {
+        lhs[i] = sm::rotate(dist(rng) * 90, dist(rng) * 90, dist(rng) * 90);
+        rhs[i] = sm::translation_by(sm::Vec3{dist(rng), dist(rng), dist(rng)});
+        vecs[i] = sm::Vec4{dist(rng), dist(rng), dist(rng), 1};
+    }
+
+    harness.run("math/mat4_mul", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = lhs[i] * rhs[i];
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/mat4_mul_scalar", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::scalar::mul(lhs[i], rhs[i]);
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/mat4_vec4", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            vec_out[i] = lhs[i] * vecs[i];
+        }
+        do_not_optimize(vec_out.data());
+    });
+
+    harness.run("math/mat4_vec4_scalar", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            vec_out[i] = sm::scalar::mul(lhs[i], vecs[i]);
+        }
+        do_not_optimize(vec_out.data());
+    });
+
+    harness.run("math/transpose", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::transpose(lhs[i]);
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/rotate", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::rotate(vecs[i].x * 90, vecs[i].y * 90, vecs[i].z * 90);
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/rotate_scalar", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::scalar::rotate(vecs[i].x * 90, vecs[i].y * 90, vecs[i].z * 90);
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/look_at", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::look_at(sm::Vec3{vecs[i].x, vecs[i].y, vecs[i].z}, sm::Vec3{0, 0, 0});
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/affine_inverse", N_MATS, [&]
+    {
+        for (u32 i = 0; i < N_MATS; i++)
+        {
+            out[i] = sm::affine_inverse(lhs[i]);
+        }
+        do_not_optimize(out.data());
+    });
+
+    harness.run("math/batch_mat4_mul", N_MATS, [&]
+    {
+        sm::mul(lhs, rhs, out);
+        do_not_optimize(out.data());
+    });
+
+    const u32 N_POINTS = 256 * 1024;
+    std::vector<sm::Vec3> points(N_POINTS);
+    for (auto& p : points)
+    {
+        p = sm::Vec3{dist(rng), dist(rng), dist(rng)};
+    }
+    std::vector<sm::Vec3x8> soa(sm::batch_blocks(N_POINTS));
+    std::vector<sm::Vec3x8> soa_out(soa.size());
+    sm::pack(points, soa);
+    sm::Mat4 xform = lhs[0] * rhs[0];
+
+    check_batch_parity(harness, soa, xform);
+
+    harness.run("math/batch_transform_points", N_POINTS, [&]
+    {
+        sm::transform_points(xform, soa, soa_out);
+        do_not_optimize(soa_out.data());
+    });
+
+    harness.run("math/batch_transform_points_scalar", N_POINTS, [&]
+    {
+        sm::scalar::transform(xform, soa, soa_out, 1.0f);
+        do_not_optimize(soa_out.data());
+    });
+
+    std::vector<sm::Vec3> points_out(N_POINTS);
+    harness.run("math/aos_transform_points", N_POINTS, [&]
+    {
+        for (u32 i = 0; i < N_POINTS; i++)
+        {
+            sm::Vec4 p = xform * sm::to_homog(points[i]);
+            points_out[i] = sm::Vec3{p.x, p.y, p.z};
+        }
+        do_not_optimize(points_out.data());
+    });
+}
+
+} // namespace bench
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "renderqueue.h"
+
+namespace bench
+{
+
+// Packets come back in a different order than std::stable_sort on the same
+// keys gives. The packet's object is its push index, and no layout reads it.
+static u64 count_misordered(sr::RenderQueue& queue, const std::vector<sr::DrawPacket>& packets)
+{
+    queue.clear();
+    std::vector<std::pair<u64, u32>> expected;
+    for (auto& packet : packets)
+    {
+        queue.push(packet);
+        expected.push_back({ queue.encode_key(packet), packet.object });
+    }
+    queue.sort();
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](auto& a, auto& b) { return a.first < b.first; });
+
+    u64 bad = 0;
+    for (u32 i = 0; i < packets.size(); i++)
+    {
+        bad += queue[i].object != expected[i].second;
+    }
+    return bad;
+}
+
+static void check_sort(Harness& harness, std::mt19937& rng)
+{
+    std::uniform_int_distribution<u32> id(0, 0xFFFFFFFF);
+    std::uniform_int_distribution<u32> few(0, 7);
+    std::uniform_real_distribution<f32> depth(0.0f, 1000.0f);
+    sr::RenderQueue queue;
+
+    // every field random, wider than the layout gives it
+    std::vector<sr::DrawPacket> packets(10000);
+    for (u32 i = 0; i < packets.size(); i++)
+    {
+        packets[i] = sr::DrawPacket{ id(rng), id(rng), id(rng), i, depth(rng) };
+    }
+    u64 bad = 0;
+    for (auto layout : { sr::SortKeyLayout::state(), sr::SortKeyLayout::front_to_back(),
+                         sr::SortKeyLayout::back_to_front() })
+    {
+        queue.set_layout(layout);
+        bad += count_misordered(queue, packets);
+    }
+    harness.check("renderqueue/sort_random", bad, 0);
+
+    // few distinct values, so most digits are shared and skipped, and long
+    // runs of equal keys have to keep push order
+    for (u32 i = 0; i < packets.size(); i++)
+    {
+        packets[i] = sr::DrawPacket{ few(rng), few(rng), few(rng), i, (f32)few(rng) };
+    }
+    queue.set_layout(sr::SortKeyLayout::state());
+    harness.check("renderqueue/sort_few_values", count_misordered(queue, packets), 0);
+
+    for (u32 i = 0; i < packets.size(); i++)
+    {
+        packets[i] = sr::DrawPacket{ 1, 2, 3, i, 4.0f };
+    }
+    harness.check("renderqueue/sort_all_equal", count_misordered(queue, packets), 0);
+
+    // only the top byte differs, every lower digit is skipped
+    queue.set_layout(sr::SortKeyLayout{ { { sr::SortKeyField_Program, 8 }, { sr::SortKeyField_Material, 56 } }, 2 });
+    for (u32 i = 0; i < packets.size(); i++)
+    {
+        packets[i] = sr::DrawPacket{ id(rng) & 0xFF, 0x12345678, 0, i, 0 };
+    }
+    harness.check("renderqueue/sort_top_byte", count_misordered(queue, packets), 0);
+}
+
+void bench_renderqueue(Harness& harness)
+{
+    std::mt19937 rng(8642);
+    check_sort(harness, rng);
+
+    const u32 N_PACKETS = 100000;
+    std::uniform_int_distribution<u32> program(0, 15);
+    std::uniform_int_distribution<u32> material(0, 255);
+    std::uniform_int_distribution<u32> geometry(0, 63);
+    std::uniform_real_distribution<f32> depth(0.1f, 500.0f);
+    std::vector<sr::DrawPacket> packets(N_PACKETS);
+    for (u32 i = 0; i < N_PACKETS; i++)
+    {
+        packets[i] = sr::DrawPacket{ program(rng), material(rng), geometry(rng), i, depth(rng) };
+    }
+
+    sr::RenderQueue queue;
+    queue.reserve(N_PACKETS);
+    harness.run("renderqueue/push_sort", N_PACKETS, [&]
+    {
+        queue.clear();
+        for (auto& packet : packets)
+        {
+            queue.push(packet);
+        }
+        queue.sort();
+        do_not_optimize(queue[0]);
+    });
+}
+
+} // namespace bench
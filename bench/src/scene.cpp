@@ -0,0 +1,99 @@
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "spennymath.h"
+#include "spennymath_batch.h"
+#include "stressscene.h"
+
+namespace bench
+{
+
+// The CPU work a frame does per object before any GL call: build the model
+// and normal matrices from a Transform, combine with the camera, and bring
+// the object's bounds into world space for culling.
+void bench_scene(Harness& harness)
+{
+    const u32 N_OBJECTS = 10000;
+
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<f32> pos(-50.0f, 50.0f);
+    std::uniform_real_distribution<f32> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<f32> scale(0.5f, 2.0f);
+
+    std::vector<sm::Transform> transforms(N_OBJECTS);
+    for (auto& t : transforms)
+    {
+        t.translation = sm::Vec3{pos(rng), pos(rng), pos(rng)};
+        t.rotation = sm::quat_euler(angle(rng), angle(rng), angle(rng));
+        f32 s = scale(rng);
+        t.scale = sm::Vec3{s, s, s};
+    }
+
+    sm::Mat4 view = sm::look_at(sm::Vec3{2, 2, 2}, sm::Vec3{0, 0, 0});
+    sm::Mat4 proj = sm::perspective(45.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+
+    std::vector<sm::Mat4> model_to_world(N_OBJECTS);
+    std::vector<sm::Mat4> normal_to_world(N_OBJECTS);
+    std::vector<sm::Mat4> mvp(N_OBJECTS);
+
+    harness.run("scene/object_matrices", N_OBJECTS, [&]
+    {
+        sm::Mat4 view_proj = proj * view;
+        for (u32 i = 0; i < N_OBJECTS; i++)
+        {
+            model_to_world[i] = sm::to_mat4(transforms[i]);
+            normal_to_world[i] = sm::normal_matrix(transforms[i]);
+            mvp[i] = view_proj * model_to_world[i];
+        }
+        do_not_optimize(mvp.data());
+    });
+
+    // 8 corners of a unit box per object, one block of 8 lanes each
+    std::vector<sm::Vec3x8> corners(N_OBJECTS);
+    std::vector<sm::Vec3x8> world_corners(N_OBJECTS);
+    for (auto& c : corners)
+    {
+        for (u32 lane = 0; lane < sm::BATCH_LANES; lane++)
+        {
+            c.x[lane] = (lane & 1) ? 0.5f : -0.5f;
+            c.y[lane] = (lane & 2) ? 0.5f : -0.5f;
+            c.z[lane] = (lane & 4) ? 0.5f : -0.5f;
+        }
+    }
+
+    harness.run("scene/world_bounds", N_OBJECTS, [&]
+    {
+        for (u32 i = 0; i < N_OBJECTS; i++)
+        {
+            sm::transform_points(model_to_world[i],
+                                 std::span(&corners[i], 1),
+                                 std::span(&world_corners[i], 1));
+        }
+        do_not_optimize(world_corners.data());
+    });
+
+    harness.run("scene/compose_hierarchy", N_OBJECTS, [&]
+    {
+        // every object parented to the one before it
+        sm::Transform world = sm::transform_I();
+        for (u32 i = 0; i < N_OBJECTS; i++)
+        {
+            world = world * transforms[i];
+            world.scale = sm::Vec3{1, 1, 1};
+        }
+        do_not_optimize(world);
+    });
+
+    sr::StressSceneConfig stress_config;
+    stress_config.n_meshes = 64;
+    stress_config.n_instances = 100000;
+    stress_config.n_lights = 1000;
+    harness.run("scene/generate_stress", stress_config.n_instances, [&]
+    {
+        auto scene = sr::StressSceneGenerator::generate(stress_config, sr::StressSceneFlags_NoTextures);
+        do_not_optimize(scene);
+    });
+}
+
+} // namespace bench
@@ -0,0 +1,162 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "vertpack.h"
+
+namespace bench
+{
+
+// What the GPU reads the packed values back as
+
+static f32 half_to_float(u16 half)
+{
+    u32 sign = (u32)(half & 0x8000) << 16;
+    u32 exponent = (half >> 10) & 0x1f;
+    u32 mantissa = half & 0x3ff;
+    if (exponent == 0)
+    {
+        // subnormal, exact in a float
+        f32 value = std::ldexp((f32)mantissa, -24);
+        return sign ? -value : value;
+    }
+
+    u32 bits = sign;
+    if (exponent == 0x1f)
+    {
+        bits |= 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits |= ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    f32 value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static f32 unpack_snorm16(i16 value)
+{
+    return std::max(value / 32767.0f, -1.0f);
+}
+
+static sm::Vec4 unpack_snorm_1010102(u32 packed)
+{
+    // sign extend each field
+    auto field = [&](u32 shift, u32 bits, f32 max) {
+        i32 v = (i32)(packed << (32 - shift - bits)) >> (32 - bits);
+        return std::max(v / max, -1.0f);
+    };
+    return sm::Vec4{ field(0, 10, 511.0f), field(10, 10, 511.0f), field(20, 10, 511.0f), field(30, 2, 1.0f) };
+}
+
+static f64 max_error(const sm::Vec3& a, const sm::Vec3& b)
+{
+    return std::max({ std::fabs(a.x - b.x), std::fabs(a.y - b.y), std::fabs(a.z - b.z) });
+}
+
+static sm::Vec3 random_unit(std::mt19937& rng)
+{
+    std::normal_distribution<f32> dist;
+    sm::Vec3 v;
+    do
+    {
+        v = sm::Vec3{ dist(rng), dist(rng), dist(rng) };
+    } while (sm::dot(v, v) < 1e-6f);
+    return sm::norm(v);
+}
+
+// Each packing against the error its format allows, decoded the way the
+// vertex fetch does it
+static void check_round_trips(Harness& harness, std::mt19937& rng)
+{
+    // every half that isn't a NaN comes back unchanged through a float
+    u64 changed = 0;
+    for (u32 half = 0; half < 0x10000; half++)
+    {
+        bool nan = (half & 0x7c00) == 0x7c00 && (half & 0x3ff);
+        changed += !nan && sr::float_to_half(half_to_float(half)) != half;
+    }
+    harness.check("vertpack/half_exact", changed, 0);
+
+    // a half's 11 significant bits round to within half an ulp, 2^-11
+    // relative, down to the smallest normal
+    std::uniform_real_distribution<f32> exponent(-14.0f, 15.9f);
+    f64 half_err = 0;
+    for (u32 i = 0; i < 100000; i++)
+    {
+        f32 value = std::exp2(exponent(rng)) * (i & 1 ? -1.0f : 1.0f);
+        half_err = std::max<f64>(half_err, std::fabs(half_to_float(sr::float_to_half(value)) - value) / std::fabs(value));
+    }
+    harness.check("vertpack/half_rel_error", half_err, std::ldexp(1.0, -11));
+
+    // 16 bit snorm octahedral normals are within about 1e-4 per component
+    f64 oct_err = 0;
+    f64 oct_exact_err = 0;
+    for (u32 i = 0; i < 100000; i++)
+    {
+        sm::Vec3 n = random_unit(rng);
+        sm::Vec2 e = sr::oct_encode(n);
+        oct_exact_err = std::max(oct_exact_err, max_error(sr::oct_decode(e), n));
+        sm::Vec2 q{ unpack_snorm16(sr::pack_snorm16(e.x)), unpack_snorm16(sr::pack_snorm16(e.y)) };
+        oct_err = std::max(oct_err, max_error(sr::oct_decode(q), n));
+    }
+    harness.check("vertpack/oct_round_trip", oct_exact_err, 1e-6);
+    harness.check("vertpack/oct_snorm16", oct_err, 1e-4);
+
+    // xyz to within half a step of 1/511, w only keeps its sign
+    f64 xyz_err = 0;
+    u64 wrong_w = 0;
+    for (u32 i = 0; i < 100000; i++)
+    {
+        sm::Vec3 t = random_unit(rng);
+        f32 w = i & 1 ? -1.0f : 1.0f;
+        sm::Vec4 unpacked = unpack_snorm_1010102(sr::pack_snorm_1010102(sm::Vec4{ t.x, t.y, t.z, w }));
+        xyz_err = std::max(xyz_err, max_error(sm::Vec3{ unpacked.x, unpacked.y, unpacked.z }, t));
+        wrong_w += unpacked.w != w;
+    }
+    harness.check("vertpack/snorm_1010102", xyz_err, 0.5 / 511 + 1e-6);
+    harness.check("vertpack/snorm_1010102_w", wrong_w, 0);
+
+    // zero and NaN normals pack as +Z
+    std::vector<sr::Vertex> verts(2);
+    verts[0].norm = sm::Vec3{ 0, 0, 0 };
+    verts[1].norm = sm::Vec3{ NAN, 0, 0 };
+    auto packed = sr::pack_vertices(verts);
+    f64 degenerate_err = 0;
+    for (auto& attributes : packed.attributes)
+    {
+        sm::Vec2 e{ unpack_snorm16(attributes.norm[0]), unpack_snorm16(attributes.norm[1]) };
+        degenerate_err = std::max(degenerate_err, max_error(sr::oct_decode(e), sm::Vec3{ 0, 0, 1 }));
+    }
+    harness.check("vertpack/degenerate_normal", degenerate_err, 0);
+}
+
+void bench_vertpack(Harness& harness)
+{
+    std::mt19937 rng(2468);
+    check_round_trips(harness, rng);
+
+    const u32 N_VERTS = 100000;
+    std::uniform_real_distribution<f32> pos(-10.0f, 10.0f);
+    std::uniform_real_distribution<f32> uv(0.0f, 1.0f);
+    std::vector<sr::Vertex> verts(N_VERTS);
+    for (auto& vert : verts)
+    {
+        vert.pos = sm::Vec3{ pos(rng), pos(rng), pos(rng) };
+        vert.norm = random_unit(rng);
+        vert.tan = random_unit(rng);
+        vert.bitan = sm::cross(vert.norm, vert.tan);
+        vert.uv = sm::Vec2{ uv(rng), uv(rng) };
+    }
+
+    harness.run("vertpack/pack_vertices", N_VERTS, [&]
+    {
+        auto packed = sr::pack_vertices(verts);
+        do_not_optimize(packed.attributes.data());
+    });
+}
+
+} // namespace bench
@@ -0,0 +1,80 @@
+#ifndef SPENNY_ALLOCTRACK_H
+#define SPENNY_ALLOCTRACK_H
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Heap allocation tracking. With SPENNY_TRACK_ALLOCS defined the library
+// replaces the global operator new/delete and counts every allocation per
+// thread, and per tag for code inside an SR_ALLOC_TAG scope. Without it the
+// hooks aren't compiled, the counters stay at zero and the frame guard does
+// nothing.
+//
+// The frame guard aborts on any allocation made by the rendering thread
+// between Renderer::begin_frame and the buffer swap in end_frame, once the
+// warmup frames are done. Only C++ allocations are seen: C libraries call
+// malloc directly, so most of what drivers allocate inside GL calls isn't
+// counted or caught. Drivers with C++ parts, like llvmpipe's shader
+// compiler, do go through the replaced operator new.
+
+struct AllocStats
+{
+    u64 allocs;
+    u64 frees;
+    u64 bytes;
+};
+
+class AllocTracker
+{
+public:
+    static constexpr u32 MAX_TAGS = 32;
+
+    // Whether the hooks were compiled in
+    static bool enabled();
+
+    // Everything the calling thread has allocated so far
+    static AllocStats thread_stats();
+
+    // Tag 0 is everything allocated outside a tag scope, on all threads
+    static u32 n_tags();
+    static const char* tag_name(u32 tag);
+    static AllocStats tag_stats(u32 tag);
+
+    // Arms the frame guard once warmup_frames frames have gone by
+    static void set_frame_guard(u32 warmup_frames);
+
+    // Called by the renderer around the frame
+    static void begin_frame();
+    static void end_frame();
+
+    // What the rendering thread allocated during the last frame
+    static AllocStats last_frame();
+};
+
+class AllocTagScope
+{
+public:
+    explicit AllocTagScope(const char* name);
+    ~AllocTagScope();
+
+    AllocTagScope(const AllocTagScope&) = delete;
+    AllocTagScope& operator=(const AllocTagScope&) = delete;
+
+private:
+    u32 prev_tag;
+};
+
+} // namespace sr
+
+#define SR_ALLOC_CONCAT_(a, b) a##b
+#define SR_ALLOC_CONCAT(a, b) SR_ALLOC_CONCAT_(a, b)
+
+#ifdef SPENNY_TRACK_ALLOCS
+#define SR_ALLOC_TAG(name) ::sr::AllocTagScope SR_ALLOC_CONCAT(sr_alloc_tag_, __LINE__)(name)
+#else
+#define SR_ALLOC_TAG(name)
+#endif
+
+#endif // SPENNY_ALLOCTRACK_H
@@ -0,0 +1,99 @@
+#ifndef SPENNY_DRAWDATA_H
+#define SPENNY_DRAWDATA_H
+
+#include <vector>
+#include <glad/glad.h>
+
+#include "model.h"
+#include "spennymath.h"
+#include "spennytypes.h"
+#include "uploadring.h"
+
+namespace sr
+{
+
+// One entry of the object array, std430 layout
+struct ObjectData
+{
+    sm::Mat4 model_to_world;
+    // transpose(inverse(model_to_world)), so shaders don't invert per vertex
+    sm::Mat4 normal_to_world;
+    // index into the material array
+    u32 material;
+    u32 pad[3];
+};
+static_assert(sizeof(ObjectData) == 144, "ObjectData has to match the std430 layout");
+
+// One entry of the material array, std430 layout
+struct MaterialData
+{
+    f32 roughness;
+    f32 metallic;
+    // 1 when the material has a normal map
+    f32 has_normal_map;
+    // read by SR_ALPHA_TEST variants only
+    f32 alpha_cutoff;
+};
+static_assert(sizeof(MaterialData) == 16, "MaterialData has to match the std430 layout");
+
+// The GLSL side of the arrays, shaders pull it in with #include "draw_data".
+// A draw's index into objects comes in as its base instance, which needs
+// GL_ARB_shader_draw_parameters enabled in the shader.
+inline const char* DRAW_DATA_GLSL = R"SRC(
+struct ObjectData
+{
+    mat4 model_to_world;
+    mat4 normal_to_world;
+    uvec4 material;
+};
+
+struct MaterialData
+{
+    vec4 properties;
+};
+
+layout (std430, binding = 1) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+layout (std430, binding = 2) readonly buffer Materials
+{
+    MaterialData materials[];
+};
+)SRC";
+
+// Per-object and per-material data for a frame, written on the CPU while
+// the frame is built and copied into the upload ring in one go before the
+// first draw. Draws pass their object index to Renderer::draw_indexed_geom,
+// so nothing is set between draws.
+class DrawData
+{
+public:
+    static constexpr u32 OBJECT_BINDING = 1;
+    static constexpr u32 MATERIAL_BINDING = 2;
+
+    void reserve(u32 n_objects, u32 n_materials);
+    void clear();
+
+    // Both return the index of the new entry, an object's is what it draws with
+    u32 push_material(const Material& material);
+    u32 push_object(const sm::Mat4& model_to_world, const sm::Mat4& normal_to_world, u32 material);
+
+    u32 n_objects() const { return objects.size(); }
+    u32 n_materials() const { return materials.size(); }
+
+    // Uploads both arrays into this frame's part of the ring and binds them
+    // to their binding points
+    void upload(UploadRing& ring);
+
+private:
+    static void upload_array(UploadRing& ring, u32 binding, const void* data, std::size_t bytes, std::size_t min_bytes);
+
+    std::vector<ObjectData> objects;
+    std::vector<MaterialData> materials;
+};
+
+} // namespace sr
+
+#endif // SPENNY_DRAWDATA_H
@@ -9,6 +9,19 @@
 namespace sr
 {
 
+// What a framebuffer's attachments are, for pipeline state
+struct RenderTargetFormat
+{
+    static constexpr u32 MAX_COLOR_ATTACHMENTS = 8;
+
+    GLenum color[MAX_COLOR_ATTACHMENTS];
+    u32 n_color;
+    // 0 without a depth attachment
+    GLenum depth;
+    // 0 when not multisampled
+    u32 samples;
+};
+
 class Framebuffer
 {
 public:
@@ -27,11 +40,19 @@ public:
         return height;
     }
 
+    const RenderTargetFormat& get_format() const noexcept
+    {
+        return format;
+    }
+
     Texture get_depth_buffer();
     Texture get_color_attachment(u32 index);
 
     void resolve_to(Framebuffer& target);
 
+    // Debug label for the framebuffer and its attachments
+    void set_label(const char* label);
+
     void put_color_attachment(Texture attachment, u32 attachment_no, u32 type = GL_TEXTURE_2D);
 
     static Framebuffer create_framebuffer(u32 width, u32 height, u32 n_color_attachments, bool use_depth_attachement = true, bool multisample = false);
@@ -44,6 +65,7 @@ private:
     u32 height;
 
     GLuint m_fbo;
+    RenderTargetFormat format;
     Texture m_depth_attachment;
     // could use GL_MAX_COLOR_ATTACHMENTS but I will likely never need that many
     Texture m_color_attachments[8];
@@ -0,0 +1,96 @@
+#ifndef SPENNY_FRAMESTATS_H
+#define SPENNY_FRAMESTATS_H
+
+#include <glad/glad.h>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// GL traffic for one frame. Counts GL calls as issued, so an unbind counts
+// as a bind too. Binds GLState dropped because they wouldn't have changed
+// anything are only counted in elided_calls.
+struct FrameStats
+{
+    u64 frame;
+
+    // a multi-draw is one call
+    u32 draw_calls;
+    u64 triangles;
+    // draws submitted through multi-draw indirect commands
+    u32 indirect_draws;
+
+    u32 program_binds;
+    u32 vao_binds;
+    u32 texture_binds;
+    u32 ubo_binds;
+    u32 framebuffer_binds;
+
+    // glBufferSubData calls and UploadRing uploads, and their bytes
+    u32 buffer_uploads;
+    u64 buffer_upload_bytes;
+
+    u32 uniform_calls;
+
+    u32 elided_calls;
+
+    // Pipelines made mid-frame instead of at load time
+    u32 late_pipelines;
+
+    // Heap allocations on the rendering thread, needs SPENNY_TRACK_ALLOCS
+    u32 heap_allocs;
+    u64 heap_bytes;
+};
+
+// Counting is a plain increment on the frame in progress, only the GL thread
+// should touch it. Renderer::end_frame moves it into the history.
+class FrameStatsCounter
+{
+public:
+    static constexpr u32 HISTORY_SIZE = 256;
+
+    static FrameStats& current() { return current_stats; }
+
+    static void end_frame()
+    {
+        u64 frame = current_stats.frame;
+        history[frame % HISTORY_SIZE] = current_stats;
+        current_stats = FrameStats{};
+        current_stats.frame = frame + 1;
+    }
+
+    // Frames that have made it into the history, capped at HISTORY_SIZE
+    static u32 history_size()
+    {
+        return current_stats.frame < HISTORY_SIZE ? current_stats.frame : HISTORY_SIZE;
+    }
+
+    // 0 is the last finished frame
+    static const FrameStats& get_history(u32 frames_ago)
+    {
+        return history[(current_stats.frame - 1 - frames_ago) % HISTORY_SIZE];
+    }
+
+    static void count_draw(u32 prim_type, u64 n_elems);
+
+private:
+    static inline FrameStats current_stats{};
+    static inline FrameStats history[HISTORY_SIZE]{};
+};
+
+inline void FrameStatsCounter::count_draw(u32 prim_type, u64 n_elems)
+{
+    current_stats.draw_calls++;
+    switch (prim_type)
+    {
+    case GL_TRIANGLES: current_stats.triangles += n_elems / 3; break;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN: current_stats.triangles += n_elems > 2 ? n_elems - 2 : 0; break;
+    default: break;
+    }
+}
+
+} // namespace sr
+
+#endif // SPENNY_FRAMESTATS_H
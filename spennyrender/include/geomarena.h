@@ -0,0 +1,256 @@
+#ifndef SPENNY_GEOMARENA_H
+#define SPENNY_GEOMARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <vector>
+#include <glad/glad.h>
+
+#include "glstate.h"
+#include "spennytypes.h"
+#include "vertbuf.h"
+
+namespace sr
+{
+
+// Where a mesh lives in a GeometryArena. Indices are relative to the mesh's
+// own vertices, base_vertex is added by the draw.
+struct GeometryRange
+{
+    u32 base_vertex;
+    u32 n_verts;
+    u32 first_index;
+    u32 n_indices;
+};
+
+// The ranges a mesh is drawn with. Arena indices are 16 bit, so a mesh with
+// more vertices than they can address is split into several, back to back
+// in the buffers, each with its own base vertex. Most meshes have one.
+using GeometryParts = std::vector<GeometryRange>;
+
+// A mesh in a GeometryArena. Stays valid until it's freed, compaction moves
+// the mesh but not the handle.
+struct GeometryHandle
+{
+    static constexpr u32 INVALID = 0xFFFFFFFF;
+
+    u32 index = INVALID;
+
+    bool is_valid() const { return index != INVALID; }
+};
+
+// One vertex buffer per stream and one 16 bit index buffer shared by many
+// meshes of the same vertex format, drawn through a single VAO with base
+// vertex and first index offsets. Drawing mesh after mesh never changes a
+// binding.
+// Split formats also get a VAO for every prefix of their streams, so a
+// depth-only pass can bind(1) and read nothing but positions.
+//
+// Freed space is reused first fit. When nothing fits the buffers grow by
+// copying into bigger ones on the GPU, and compact() closes the holes left
+// by freed meshes the same way.
+class GeometryArenaBase
+{
+public:
+    GeometryArenaBase(const GeometryArenaBase&) = delete;
+    GeometryArenaBase& operator=(const GeometryArenaBase&) = delete;
+
+    // Grows the buffers to at least this many vertices and indices up front,
+    // instead of doubling a few times while meshes are added
+    void reserve(u32 n_verts, u32 n_indices);
+
+    static constexpr u32 MAX_STREAMS = 4;
+
+    using Index = u16;
+    static constexpr GLenum INDEX_TYPE = GL_UNSIGNED_SHORT;
+
+    // streams has one array per stream, n_verts long, of its stride. Meshes
+    // over MAX_U16_INDEXED_VERTS vertices are split, which only works for
+    // point, line and triangle lists and duplicates the vertices shared
+    // across a split.
+    GeometryHandle allocate(const void* const* streams, u32 n_verts, const u32* indices, u32 n_indices);
+    void free(GeometryHandle mesh);
+
+    // Moves every live mesh to the start of the buffers, leaving all the free
+    // space in one piece at the end
+    void compact();
+
+    const GeometryParts& get(GeometryHandle mesh) const
+    {
+        return parts[mesh.index];
+    }
+
+    // Reads only the first n_streams streams
+    void bind(u32 n_streams = ALL_STREAMS) const
+    {
+        GLState::bind_vertex_array(get_vao(n_streams));
+    }
+
+    GLuint get_vao(u32 n_streams = ALL_STREAMS) const
+    {
+        assert(n_streams > 0 && "A VAO needs at least one stream");
+        return vaos[std::min(n_streams, n_streams_total) - 1];
+    }
+    u32 get_n_streams() const { return n_streams_total; }
+
+    // Growing and compacting replace the buffers, don't hold on to these
+    GLuint get_vertex_buffer(u32 stream) const { return vbos[stream]; }
+    GLuint get_index_buffer() const { return ebo; }
+    GLenum get_prim_type() const { return prim_type; }
+
+    u32 get_n_meshes() const { return ranges.size() - free_handles.size(); }
+    u32 get_used_vertices() const { return used_verts; }
+    u32 get_vertex_capacity() const { return vertex_capacity; }
+    u32 get_used_indices() const { return used_indices; }
+    u32 get_index_capacity() const { return index_capacity; }
+
+    void set_label(const char* label);
+
+protected:
+    GeometryArenaBase(const u32* strides, u32 n_streams, u32 vertex_capacity, u32 index_capacity,
+                      GLenum prim_type);
+
+    // vaos[i] reads streams 0 to i
+    GLuint vaos[MAX_STREAMS];
+
+private:
+    // a run of free vertices or indices
+    struct Block
+    {
+        u32 start;
+        u32 size;
+    };
+
+    static bool take(std::vector<Block>& free_list, u32 size, u32& start);
+    static void give_back(std::vector<Block>& free_list, Block block);
+
+    // the indices in 16 bit pieces, see allocate
+    struct SplitMesh
+    {
+        // the source vertex of every vertex of the pieces, empty when the
+        // mesh didn't need splitting and they're the same
+        std::vector<u32> vertex_sources;
+        std::vector<Index> indices;
+        // relative to the start of the mesh's vertices and indices
+        GeometryParts pieces;
+    };
+
+    SplitMesh split(u32 n_verts, const u32* indices, u32 n_indices) const;
+
+    GLuint create_buffer(std::size_t bytes, const char* label);
+    void grow_vertices(u32 min_capacity);
+    void grow_indices(u32 min_capacity);
+    void attach_buffers();
+
+    u32 n_streams_total;
+    u32 strides[MAX_STREAMS];
+    GLenum prim_type;
+
+    GLuint vbos[MAX_STREAMS];
+    GLuint ebo;
+    u32 vertex_capacity;
+    u32 index_capacity;
+    u32 used_verts;
+    u32 used_indices;
+
+    // by start, neighbours merged
+    std::vector<Block> free_verts;
+    std::vector<Block> free_indices;
+
+    // by handle index, ranges covers all of a mesh's parts
+    std::vector<GeometryRange> ranges;
+    std::vector<GeometryParts> parts;
+    std::vector<bool> live;
+    std::vector<u32> free_handles;
+};
+
+// What glMultiDrawElementsIndirect reads for each draw
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instance_count;
+    u32 first_index;
+    i32 base_vertex;
+    // the object index, shaders read it as gl_BaseInstanceARB
+    u32 base_instance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand has to match GL's layout");
+
+// Draws of meshes from one arena, collected to go out in a single
+// Renderer::multi_draw_indexed_geom. Storage only grows.
+class IndirectDrawList
+{
+public:
+    void reserve(u32 n_draws)
+    {
+        commands.reserve(n_draws);
+    }
+
+    void clear()
+    {
+        commands.clear();
+        n_indices = 0;
+    }
+
+    void push(const GeometryRange& range, u32 object)
+    {
+        commands.push_back(DrawElementsIndirectCommand{
+            range.n_indices, 1, range.first_index, (i32)range.base_vertex, object });
+        n_indices += range.n_indices;
+    }
+
+    void push(const GeometryParts& parts, u32 object)
+    {
+        for (auto& range : parts)
+        {
+            push(range, object);
+        }
+    }
+
+    u32 size() const { return commands.size(); }
+    bool empty() const { return commands.empty(); }
+    const DrawElementsIndirectCommand* data() const { return commands.data(); }
+    // over all the draws
+    u64 get_n_indices() const { return n_indices; }
+
+private:
+    std::vector<DrawElementsIndirectCommand> commands;
+    u64 n_indices = 0;
+};
+
+template<typename Vert>
+class GeometryArena : public GeometryArenaBase
+{
+    using Streams = typename StreamsOf<Vert>::Type;
+    static_assert(StreamInfo<Streams>::COUNT <= MAX_STREAMS, "Too many streams for a geometry arena");
+public:
+    static constexpr u32 DEFAULT_VERTEX_CAPACITY = 1 << 16;
+    static constexpr u32 DEFAULT_INDEX_CAPACITY = 1 << 18;
+
+    explicit GeometryArena(u32 vertex_capacity = DEFAULT_VERTEX_CAPACITY,
+                           u32 index_capacity = DEFAULT_INDEX_CAPACITY,
+                           GLenum prim_type = GL_TRIANGLES)
+        : GeometryArenaBase(StreamInfo<Streams>::STRIDES, StreamInfo<Streams>::COUNT,
+                            vertex_capacity, index_capacity, prim_type)
+    {
+        for (u32 i = 0; i < StreamInfo<Streams>::COUNT; i++)
+        {
+            GLState::bind_vertex_array(vaos[i]);
+            configure_stream_formats<Vert>(i + 1);
+        }
+    }
+
+    // One array per stream, in order, each n_verts long
+    template<typename... Data>
+    GeometryHandle add(u32 n_verts, const u32* indices, u32 n_indices, const Data*... streams)
+    {
+        static_assert(std::is_same<VertexStreams<Data...>, Streams>(), "add takes one array per stream");
+        const void* data[] = { streams... };
+        return allocate(data, n_verts, indices, n_indices);
+    }
+};
+
+} // namespace sr
+
+#endif // SPENNY_GEOMARENA_H
@@ -0,0 +1,92 @@
+#ifndef SPENNY_GLDEBUG_H
+#define SPENNY_GLDEBUG_H
+
+#include <iostream>
+#include <glad/glad.h>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// GL debug output through GL_KHR_debug. The driver's messages go into a
+// fixed-size lock-free queue from its callback, which may run on a driver
+// thread, and are printed from the GL thread once a frame by flush(). GL
+// objects get labels and passes get debug groups, so messages and captures
+// in tools like RenderDoc read by name.
+//
+// All of it is only built with SPENNY_RENDER_DEBUG (debug builds). Without
+// it the macros below expand to nothing and no error checking happens on
+// the GL thread at all.
+
+struct GLDebugMessage
+{
+    static constexpr u32 MAX_LENGTH = 512;
+
+    GLenum source;
+    GLenum type;
+    GLenum severity;
+    GLuint id;
+    // truncated to MAX_LENGTH - 1
+    char text[MAX_LENGTH];
+};
+
+class GLDebug
+{
+public:
+    // Power of two. Messages that arrive while it's full are dropped and
+    // counted.
+    static constexpr u32 QUEUE_CAPACITY = 256;
+
+    // Turns on debug output and installs the callback, notifications are
+    // filtered out. Needs a current context, ideally one created with the
+    // debug flag.
+    static void enable();
+
+    // Prints the queued messages, returns how many there were
+    static u32 flush(std::ostream& os);
+
+    static void label(GLenum identifier, GLuint name, const char* label);
+    static void push_group(const char* name);
+    static void pop_group();
+};
+
+class GLDebugGroup
+{
+public:
+    explicit GLDebugGroup(const char* name)
+    {
+        GLDebug::push_group(name);
+    }
+
+    ~GLDebugGroup()
+    {
+        GLDebug::pop_group();
+    }
+
+    GLDebugGroup(const GLDebugGroup&) = delete;
+    GLDebugGroup& operator=(const GLDebugGroup&) = delete;
+};
+
+} // namespace sr
+
+#ifdef SPENNY_RENDER_DEBUG
+#define SR_GL_DEBUG_ENABLE() ::sr::GLDebug::enable()
+#define SR_GL_DEBUG_FLUSH() ::sr::GLDebug::flush(std::cerr)
+#define SR_GL_LABEL(identifier, name, text) ::sr::GLDebug::label(identifier, name, text)
+#define SR_GL_DEBUG_GROUP(name) ::sr::GLDebugGroup SR_GL_DEBUG_CONCAT(sr_gl_debug_group_, __LINE__)(name)
+#define SR_GL_PUSH_GROUP(name) ::sr::GLDebug::push_group(name)
+#define SR_GL_POP_GROUP() ::sr::GLDebug::pop_group()
+#else
+#define SR_GL_DEBUG_ENABLE()
+#define SR_GL_DEBUG_FLUSH()
+#define SR_GL_LABEL(identifier, name, text)
+#define SR_GL_DEBUG_GROUP(name)
+#define SR_GL_PUSH_GROUP(name)
+#define SR_GL_POP_GROUP()
+#endif
+
+#define SR_GL_DEBUG_CONCAT_(a, b) a##b
+#define SR_GL_DEBUG_CONCAT(a, b) SR_GL_DEBUG_CONCAT_(a, b)
+
+#endif // SPENNY_GLDEBUG_H
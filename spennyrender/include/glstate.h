@@ -0,0 +1,346 @@
+#ifndef SPENNY_GLSTATE_H
+#define SPENNY_GLSTATE_H
+
+#include <glad/glad.h>
+
+#include "framestats.h"
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Shadow copy of the GL bindings and fixed-function state the renderer
+// uses. The wrappers bind through here, calls that wouldn't change anything
+// are dropped and counted in FrameStats::elided_calls, the rest are counted
+// as binds.
+//
+// The copy is only right while nothing binds behind its back. Code that
+// calls glBind* directly, or deletes an object that's bound, has to call
+// invalidate() afterwards. The element array binding belongs to the VAO and
+// isn't tracked.
+class GLState
+{
+public:
+    static constexpr u32 MAX_TEXTURE_UNITS = 16;
+    static constexpr u32 MAX_UNIFORM_BUFFER_BINDINGS = 16;
+    static constexpr u32 MAX_SHADER_STORAGE_BUFFER_BINDINGS = 8;
+
+    static void use_program(GLuint program)
+    {
+        if (skip(s.program, program))
+        {
+            return;
+        }
+        FrameStatsCounter::current().program_binds++;
+        glUseProgram(program);
+    }
+
+    static void bind_vertex_array(GLuint vao)
+    {
+        if (skip(s.vao, vao))
+        {
+            return;
+        }
+        FrameStatsCounter::current().vao_binds++;
+        glBindVertexArray(vao);
+    }
+
+    static void bind_buffer(GLenum target, GLuint buffer)
+    {
+        GLuint* bound = buffer_slot(target);
+        if (bound && skip(*bound, buffer))
+        {
+            return;
+        }
+        if (target == GL_UNIFORM_BUFFER)
+        {
+            FrameStatsCounter::current().ubo_binds++;
+        }
+        glBindBuffer(target, buffer);
+    }
+
+    // Also binds the buffer to target, like GL does
+    static void bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+    {
+        if (target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BUFFER_BINDINGS)
+        {
+            if (skip(s.uniform_buffer_bases[index], buffer))
+            {
+                return;
+            }
+            s.uniform_buffer = buffer;
+            FrameStatsCounter::current().ubo_binds++;
+        }
+        else if (target == GL_SHADER_STORAGE_BUFFER && index < MAX_SHADER_STORAGE_BUFFER_BINDINGS)
+        {
+            if (skip(s.shader_storage_buffer_bases[index], buffer))
+            {
+                return;
+            }
+            s.shader_storage_buffer = buffer;
+        }
+        glBindBufferBase(target, index, buffer);
+    }
+
+    // Ranges move every frame, so these aren't cached, only the bindings
+    // they overwrite are updated
+    static void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if (target == GL_UNIFORM_BUFFER)
+        {
+            if (index < MAX_UNIFORM_BUFFER_BINDINGS)
+            {
+                s.uniform_buffer_bases[index] = UNKNOWN;
+            }
+            s.uniform_buffer = buffer;
+            FrameStatsCounter::current().ubo_binds++;
+        }
+        else if (target == GL_SHADER_STORAGE_BUFFER)
+        {
+            if (index < MAX_SHADER_STORAGE_BUFFER_BINDINGS)
+            {
+                s.shader_storage_buffer_bases[index] = UNKNOWN;
+            }
+            s.shader_storage_buffer = buffer;
+        }
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    // unit is GL_TEXTURE0 + n
+    static void active_texture(GLenum unit)
+    {
+        if (skip(s.active_unit, unit))
+        {
+            return;
+        }
+        glActiveTexture(unit);
+    }
+
+    static void bind_texture(GLenum unit, GLenum target, GLuint texture)
+    {
+        u32 unit_index = unit - GL_TEXTURE0;
+        i32 target_index = texture_target_index(target);
+        if (unit_index < MAX_TEXTURE_UNITS && target_index >= 0
+            && skip(s.textures[unit_index][target_index], texture))
+        {
+            return;
+        }
+        active_texture(unit);
+        FrameStatsCounter::current().texture_binds++;
+        glBindTexture(target, texture);
+    }
+
+    // On whatever unit is active, for creating and filling textures
+    static void bind_texture(GLenum target, GLuint texture)
+    {
+        bind_texture(s.active_unit == UNKNOWN ? GL_TEXTURE0 : s.active_unit, target, texture);
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and read framebuffer
+    static void bind_framebuffer(GLenum target, GLuint fbo)
+    {
+        bool draw = target != GL_READ_FRAMEBUFFER;
+        bool read = target != GL_DRAW_FRAMEBUFFER;
+        if ((!draw || s.draw_framebuffer == fbo) && (!read || s.read_framebuffer == fbo))
+        {
+            FrameStatsCounter::current().elided_calls++;
+            return;
+        }
+        if (draw)
+        {
+            s.draw_framebuffer = fbo;
+        }
+        if (read)
+        {
+            s.read_framebuffer = fbo;
+        }
+        FrameStatsCounter::current().framebuffer_binds++;
+        glBindFramebuffer(target, fbo);
+    }
+
+    static void viewport(i32 x, i32 y, i32 w, i32 h)
+    {
+        auto& v = s.viewport;
+        if (v[0] == x && v[1] == y && v[2] == w && v[3] == h)
+        {
+            FrameStatsCounter::current().elided_calls++;
+            return;
+        }
+        v[0] = x;
+        v[1] = y;
+        v[2] = w;
+        v[3] = h;
+        glViewport(x, y, w, h);
+    }
+
+    // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are cached, anything else
+    // goes straight through
+    static void enable(GLenum cap, bool on)
+    {
+        GLuint* enabled = capability_slot(cap);
+        if (enabled && skip(*enabled, on))
+        {
+            return;
+        }
+        if (on)
+        {
+            glEnable(cap);
+        }
+        else
+        {
+            glDisable(cap);
+        }
+    }
+
+    static void depth_mask(bool write)
+    {
+        if (skip(s.depth_mask, write))
+        {
+            return;
+        }
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    static void depth_func(GLenum func)
+    {
+        if (skip(s.depth_func, func))
+        {
+            return;
+        }
+        glDepthFunc(func);
+    }
+
+    static void blend_func(GLenum src, GLenum dst)
+    {
+        if (s.blend_src == src && s.blend_dst == dst)
+        {
+            FrameStatsCounter::current().elided_calls++;
+            return;
+        }
+        s.blend_src = src;
+        s.blend_dst = dst;
+        glBlendFunc(src, dst);
+    }
+
+    static void cull_face(GLenum face)
+    {
+        if (skip(s.cull_face, face))
+        {
+            return;
+        }
+        glCullFace(face);
+    }
+
+    // Forget everything, the next call of each kind goes through to GL
+    static void invalidate()
+    {
+        s = State{};
+    }
+
+private:
+    static constexpr GLuint UNKNOWN = 0xffffffff;
+
+    // slots for GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_MULTISAMPLE
+    // and GL_TEXTURE_BUFFER, other targets aren't cached
+    static constexpr u32 N_TEXTURE_TARGETS = 4;
+
+    struct State
+    {
+        GLuint program = UNKNOWN;
+        GLuint vao = UNKNOWN;
+        GLuint array_buffer = UNKNOWN;
+        GLuint uniform_buffer = UNKNOWN;
+        GLuint texture_buffer = UNKNOWN;
+        GLuint shader_storage_buffer = UNKNOWN;
+        GLuint draw_indirect_buffer = UNKNOWN;
+        GLuint uniform_buffer_bases[MAX_UNIFORM_BUFFER_BINDINGS] = {
+            UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+            UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+        };
+        GLuint shader_storage_buffer_bases[MAX_SHADER_STORAGE_BUFFER_BINDINGS] = {
+            UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+        };
+        GLenum active_unit = UNKNOWN;
+        GLuint textures[MAX_TEXTURE_UNITS][N_TEXTURE_TARGETS];
+        GLuint draw_framebuffer = UNKNOWN;
+        GLuint read_framebuffer = UNKNOWN;
+        // x, y, w, h, a width of -1 never matches
+        i32 viewport[4] = { 0, 0, -1, -1 };
+        GLuint depth_test = UNKNOWN;
+        GLuint blend = UNKNOWN;
+        GLuint cull = UNKNOWN;
+        GLuint depth_mask = UNKNOWN;
+        GLenum depth_func = UNKNOWN;
+        GLenum blend_src = UNKNOWN;
+        GLenum blend_dst = UNKNOWN;
+        GLenum cull_face = UNKNOWN;
+
+        State()
+        {
+            for (auto& unit : textures)
+            {
+                for (auto& texture : unit)
+                {
+                    texture = UNKNOWN;
+                }
+            }
+        }
+    };
+
+    // true, and counted, when bound already holds value. Otherwise it's
+    // updated for the call the caller is about to make.
+    static bool skip(GLuint& bound, GLuint value)
+    {
+        if (bound == value)
+        {
+            FrameStatsCounter::current().elided_calls++;
+            return true;
+        }
+        bound = value;
+        return false;
+    }
+
+    static GLuint* buffer_slot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return &s.array_buffer;
+        case GL_UNIFORM_BUFFER: return &s.uniform_buffer;
+        case GL_TEXTURE_BUFFER: return &s.texture_buffer;
+        case GL_SHADER_STORAGE_BUFFER: return &s.shader_storage_buffer;
+        case GL_DRAW_INDIRECT_BUFFER: return &s.draw_indirect_buffer;
+        default: return nullptr;
+        }
+    }
+
+    static GLuint* capability_slot(GLenum cap)
+    {
+        switch (cap)
+        {
+        case GL_DEPTH_TEST: return &s.depth_test;
+        case GL_BLEND: return &s.blend;
+        case GL_CULL_FACE: return &s.cull;
+        default: return nullptr;
+        }
+    }
+
+    static i32 texture_target_index(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        case GL_TEXTURE_2D_MULTISAMPLE: return 2;
+        case GL_TEXTURE_BUFFER: return 3;
+        default: return -1;
+        }
+    }
+
+    static State s;
+};
+
+inline GLState::State GLState::s{};
+
+} // namespace sr
+
+#endif // SPENNY_GLSTATE_H
@@ -0,0 +1,110 @@
+#ifndef SPENNY_GPUPROFILER_H
+#define SPENNY_GPUPROFILER_H
+
+#include <vector>
+#include <glad/glad.h>
+
+#include "profiler.h"
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// GPU pass timing. Passes are bracketed with GL_TIMESTAMP queries (timestamps
+// rather than GL_TIME_ELAPSED so passes can nest). Each frame's queries live
+// in one slot of a ring and are only read once the GPU has finished with
+// them, a few frames later, so timing never stalls the pipeline. If a slot
+// comes round again before its results are in, that frame is dropped.
+//
+// Finished passes are also sent to Profiler::record_gpu, so they show up
+// under the CPU scopes in the Chrome trace.
+//
+// Renderer::begin_frame/end_frame drive the frame, SR_GPU_PROFILE_SCOPE or
+// the BEGIN/END pair time a pass. Like the CPU scopes they compile to
+// nothing without SPENNY_PROFILE.
+
+struct GpuPassTiming
+{
+    const char* name;
+    // 0 for top level passes
+    u32 depth;
+    f64 ms;
+};
+
+struct GpuFrameTiming
+{
+    // Counts from 1
+    u64 frame;
+    f64 frame_ms;
+    std::vector<GpuPassTiming> passes;
+};
+
+class GpuProfiler
+{
+public:
+    // Frames in flight before a slot is reused
+    static constexpr u32 RING_SIZE = 4;
+
+    // Called with every frame as its results come back, oldest first. It
+    // runs inside Renderer::begin_frame, so it shouldn't allocate.
+    using FrameListener = void (*)(const GpuFrameTiming& timing, void* user);
+
+    static void begin_frame();
+    static void end_frame();
+
+    static void begin_pass(const char* name);
+    static void end_pass();
+
+    // The most recent frame whose results have come back, frame is 0 until
+    // the first one does.
+    static const GpuFrameTiming& latest();
+
+    // Frames whose queries were still pending when their slot was needed
+    static u64 dropped_frames();
+
+    // What GpuFrameTiming::frame will be for the last frame end_frame closed,
+    // 0 before the first
+    static u64 last_frame();
+
+    // Waits for every frame still in flight and reads it back, e.g. before
+    // reporting at the end of a run
+    static void flush();
+
+    // One listener at a time, nullptr removes it
+    static void set_listener(FrameListener listener, void* user);
+};
+
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* name)
+    {
+        GpuProfiler::begin_pass(name);
+    }
+
+    ~GpuProfileScope()
+    {
+        GpuProfiler::end_pass();
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
+
+} // namespace sr
+
+#ifdef SPENNY_PROFILE
+#define SR_GPU_PROFILE_BEGIN_FRAME() ::sr::GpuProfiler::begin_frame()
+#define SR_GPU_PROFILE_END_FRAME() ::sr::GpuProfiler::end_frame()
+#define SR_GPU_PROFILE_SCOPE(name) ::sr::GpuProfileScope SR_PROFILE_CONCAT(sr_gpu_profile_scope_, __LINE__)(name)
+#define SR_GPU_PROFILE_BEGIN(name) ::sr::GpuProfiler::begin_pass(name)
+#define SR_GPU_PROFILE_END() ::sr::GpuProfiler::end_pass()
+#else
+#define SR_GPU_PROFILE_BEGIN_FRAME()
+#define SR_GPU_PROFILE_END_FRAME()
+#define SR_GPU_PROFILE_SCOPE(name)
+#define SR_GPU_PROFILE_BEGIN(name)
+#define SR_GPU_PROFILE_END()
+#endif
+
+#endif // SPENNY_GPUPROFILER_H
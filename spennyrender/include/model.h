@@ -42,6 +42,10 @@ struct Material
     f32 roughness;
     Texture diffuse;
     Texture normals;
+    // glTF's MASK alpha mode: draws with ShaderFeature_AlphaTest discard
+    // fragments whose diffuse alpha is under the cutoff
+    bool alpha_test = false;
+    f32 alpha_cutoff = 0.5f;
     // stats...
 };
 
@@ -52,10 +56,18 @@ struct Model
     // materials
 };
 
+enum ModelLoadFlags
+{
+    ModelLoadFlags_None = 0,
+    // Skip decoding and uploading textures. Everything else is loaded as
+    // normal, which makes this usable without a GL context.
+    ModelLoadFlags_NoTextures = 1 << 0,
+};
+
 class ModelLoader
 {
 public:
-    std::optional<Model> load_from_file(const std::string& filename);
+    std::optional<Model> load_from_file(const std::string& filename, u32 flags = ModelLoadFlags_None);
 };
 
 
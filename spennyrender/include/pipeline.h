@@ -0,0 +1,125 @@
+#ifndef SPENNY_PIPELINE_H
+#define SPENNY_PIPELINE_H
+
+#include <vector>
+#include <glad/glad.h>
+
+#include "framebuf.h"
+#include "spennytypes.h"
+#include "vertbuf.h"
+
+namespace sr
+{
+
+enum BlendMode
+{
+    BlendMode_Opaque,
+    BlendMode_Alpha,
+    BlendMode_Additive,
+};
+
+enum CullMode
+{
+    CullMode_None,
+    CullMode_Back,
+    CullMode_Front,
+};
+
+struct DepthState
+{
+    bool test = true;
+    bool write = true;
+    GLenum func = GL_LEQUAL;
+};
+
+// Everything about a draw a driver may compile into its shaders: the
+// program, the vertex format, the render target formats and the fixed
+// function state.
+struct PipelineDesc
+{
+    GLuint program = 0;
+    // vertex_layout_key<Vert>(), or of a VertexStreams of just the streams
+    // the pass binds
+    u64 vertex_layout = 0;
+    RenderTargetFormat target{};
+    DepthState depth;
+    BlendMode blend = BlendMode_Opaque;
+    CullMode cull = CullMode_None;
+
+    u64 hash() const;
+    bool operator==(const PipelineDesc& other) const;
+};
+
+// An immutable PipelineDesc, made and owned by PipelineCache
+class Pipeline
+{
+public:
+    // Binds the program and sets the depth, blend and cull state. The VAO
+    // and framebuffer are up to the caller.
+    void bind() const;
+
+    const PipelineDesc& get_desc() const { return desc; }
+    u64 get_hash() const { return hash; }
+
+private:
+    friend class PipelineCache;
+
+    Pipeline(const PipelineDesc& desc, u64 hash);
+
+    PipelineDesc desc;
+    u64 hash;
+};
+
+// A pipeline that was made between Renderer::begin_frame and end_frame, so
+// its first draw may have stalled while the driver compiled it
+struct LatePipeline
+{
+    u64 frame;
+    u64 hash;
+    PipelineDesc desc;
+};
+
+// Every pipeline the renderer has used, by hash. Make the ones a scene needs
+// at load time and prewarm() them, then any made mid-frame are reported in
+// late_pipelines() and FrameStats::late_pipelines.
+class PipelineCache
+{
+public:
+    // The pipeline for desc, made the first time it's asked for. The
+    // reference stays valid.
+    static const Pipeline& get(const PipelineDesc& desc);
+
+    // Prewarming draws need a VAO of each vertex format
+    template<typename Vert>
+    static void register_vertex_layout()
+    {
+        if (has_vertex_layout(vertex_layout_key<Vert>()))
+        {
+            return;
+        }
+        // three zeroed vertices, enough for a triangle
+        VertexBuffer<Vert> buf;
+        buf.buffer_zeroed(3);
+        add_vertex_layout(vertex_layout_key<Vert>(), buf.get_vao());
+    }
+
+    // Draws a triangle into a tiny offscreen target with every pipeline made
+    // since the last call, then waits for the GPU, so drivers that compile
+    // lazily do it now. Leaves the default framebuffer bound.
+    static void prewarm();
+
+    // Called by the Renderer
+    static void begin_frame();
+    static void end_frame();
+
+    static u32 n_pipelines();
+    static const std::vector<LatePipeline>& late_pipelines();
+
+private:
+    static bool has_vertex_layout(u64 key);
+    static void add_vertex_layout(u64 key, GLuint vao);
+};
+
+} // namespace sr
+
+#endif // SPENNY_PIPELINE_H
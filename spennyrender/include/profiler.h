@@ -0,0 +1,91 @@
+#ifndef SPENNY_PROFILER_H
+#define SPENNY_PROFILER_H
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Scoped CPU profiler. SR_PROFILE_SCOPE("name") records the time spent until
+// the end of the enclosing scope. Events go into a per-thread ring buffer
+// with no locking on the record path, and the last few frames can be written
+// out as a Chrome trace (chrome://tracing or ui.perfetto.dev). A new thread
+// takes over the buffer of one that has exited, all of them are freed at
+// exit.
+//
+// Without SPENNY_PROFILE defined the macros expand to nothing.
+//
+// Names must be string literals or otherwise outlive the profiler, only the
+// pointer is stored.
+
+struct ProfileEvent
+{
+    const char* name;
+    u64 start_ns;
+    u64 end_ns;
+};
+
+class Profiler
+{
+public:
+    // Per thread, oldest events are overwritten once it's full
+    static constexpr u32 THREAD_CAPACITY = 1 << 16;
+    static constexpr u32 FRAME_CAPACITY = 256;
+
+    static u64 now_ns();
+
+    static void record(const char* name, u64 start_ns, u64 end_ns);
+
+    // Events on the GPU timeline, already converted to now_ns() time. Shows
+    // up as its own track in the trace. Call from the GL thread only.
+    static void record_gpu(const char* name, u64 start_ns, u64 end_ns);
+
+    // Marks the start of a frame, dumps are cut at frame boundaries
+    static void mark_frame();
+
+    // Writes events from the last n_frames frames, including the one in
+    // progress. Events recorded while the rings are copied out are dropped,
+    // so nothing is overwritten mid-read.
+    static void write_chrome_trace(std::ostream& os, u32 n_frames);
+    static bool write_chrome_trace(const std::string& path, u32 n_frames);
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : name(name), start_ns(Profiler::now_ns())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::record(name, start_ns, Profiler::now_ns());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    u64 start_ns;
+};
+
+} // namespace sr
+
+#define SR_PROFILE_CONCAT_(a, b) a##b
+#define SR_PROFILE_CONCAT(a, b) SR_PROFILE_CONCAT_(a, b)
+
+#ifdef SPENNY_PROFILE
+#define SR_PROFILE_SCOPE(name) ::sr::ProfileScope SR_PROFILE_CONCAT(sr_profile_scope_, __LINE__)(name)
+#define SR_PROFILE_FRAME() ::sr::Profiler::mark_frame()
+#else
+#define SR_PROFILE_SCOPE(name)
+#define SR_PROFILE_FRAME()
+#endif
+
+#endif // SPENNY_PROFILER_H
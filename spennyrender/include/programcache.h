@@ -0,0 +1,54 @@
+#ifndef SPENNY_PROGRAMCACHE_H
+#define SPENNY_PROGRAMCACHE_H
+
+#include <string>
+#include <glad/glad.h>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// On-disk cache of linked program binaries (glGetProgramBinary). Entries are
+// keyed by a hash of the shader sources, their defines and the GL_RENDERER
+// and GL_VERSION strings, so a driver update or a different GPU just misses
+// instead of loading a binary the driver would reject. Binaries the driver
+// rejects anyway are recompiled and overwritten.
+//
+// Off until enable() is called with a directory. Shader::load_program goes
+// through it.
+
+struct ProgramCacheStats
+{
+    u32 hits;
+    u32 misses;
+    u32 stores;
+
+    // Time spent loading binaries, and the compile + link time those loads
+    // replaced minus that
+    f64 load_ms;
+    f64 saved_ms;
+};
+
+class ProgramCache
+{
+public:
+    // Needs a current GL context. Returns false and stays off if the driver
+    // has no binary formats or the directory can't be created.
+    static bool enable(const std::string& dir);
+    static bool enabled();
+
+    static u64 program_key(const std::string& vs_src, const std::string& fs_src, const std::string& defines);
+
+    // A linked program from the cache, 0 on a miss
+    static GLuint load(u64 key);
+
+    // program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    static void store(u64 key, GLuint program, u64 compile_ns);
+
+    static const ProgramCacheStats& stats();
+};
+
+} // namespace sr
+
+#endif // SPENNY_PROGRAMCACHE_H
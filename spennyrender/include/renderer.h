@@ -6,61 +6,57 @@
 #include <SDL3/SDL.h>
 
 #include "framebuf.h"
+#include "framestats.h"
+#include "geomarena.h"
 #include "spennytypes.h"
 #include "spennymath.h"
+#include "uploadring.h"
 #include "vertbuf.h"
 #include "model.h"
 
 namespace sr
 {
 
-inline const char * GetGLErrorStr(GLenum err)
-{
-    switch (err)
-    {
-    case GL_NO_ERROR:          return "No error";
-    case GL_INVALID_ENUM:      return "Invalid enum";
-    case GL_INVALID_VALUE:     return "Invalid value";
-    case GL_INVALID_OPERATION: return "Invalid operation";
-    case GL_STACK_OVERFLOW:    return "Stack overflow";
-    case GL_STACK_UNDERFLOW:   return "Stack underflow";
-    case GL_OUT_OF_MEMORY:     return "Out of memory";
-    default:                   return "Unknown error";
-    }
-}
-
-inline void CheckGLError()
-{
-    while (true)
-    {
-        const GLenum err = glGetError();
-        if (GL_NO_ERROR == err)
-            break;
-
-        std::cout << "GL Error: " << GetGLErrorStr(err) << std::endl;
-    }
-}
-
 struct GlobalUniforms
 {
     // x & y are screen dimensions, z & w are front/back clip
     sm::Vec4 clip;
     sm::Vec4 camera_position;
 
-    // roughness, metallic, has normal, pad
-    sm::Vec4 material_properties;
-
     sm::Mat4 view;
     sm::Mat4 perspective;
 
     // TODO: lights here
 };
 
+// The GLSL side of GlobalUniforms, shaders pull it in with
+// #include "global_uniforms"
+inline const char* GLOBAL_UNIFORMS_GLSL = R"SRC(
+layout (std140) uniform GlobalUniforms
+{
+    vec4 clip;
+    vec4 camera_pos;
+    mat4 view;
+    mat4 perspective;
+};
+)SRC";
+
+enum RendererFlags
+{
+    RendererFlags_None = 0,
+    // Render without a visible window, through SDL's offscreen video driver.
+    // Works on machines with no display and no GPU, e.g. Mesa llvmpipe.
+    RendererFlags_Headless = 1 << 0,
+    RendererFlags_NoVsync = 1 << 1,
+};
+
 class Renderer
 {
 public:
 
-    static void start(const std::string& win_title, u32 w, u32 h);
+    // False if there's no window or GL context, or the context is missing
+    // something the renderer needs. The reason goes to stderr.
+    static bool start(const std::string& win_title, u32 w, u32 h, u32 flags = RendererFlags_None);
     static void end();
 
     static void begin_frame();
@@ -68,25 +64,60 @@ public:
     static std::unique_ptr<Framebuffer>& get_default_framebuffer();
     static void set_clear_color(sm::Vec4 rgba);
 
+    // Per-frame GPU data goes through here, allocations last until
+    // end_frame
+    static UploadRing& get_upload_ring();
+
+    // Counters for the last finished frame, and the ones before it
+    static const FrameStats& get_frame_stats();
+    static const FrameStats& get_frame_stats_history(u32 frames_ago);
+    static u32 get_frame_stats_history_size();
+
     static void set_camera_position(sm::Vec3 camera_pos);
     static void set_camera_target(sm::Vec3 camera_target);
     static void set_fovy(f32 fovy);
     static void set_near_clip(f32 near_clip);
     static void set_far_clip(f32 far_clip);
 
-    static void use_material(Material& material);
-
+    // object is the draw's index into DrawData's object array, shaders get
+    // it as gl_BaseInstanceARB
     template<typename Vert>
-    static void draw_indexed_geom(IndexedGeometry<Vert>& geom)
+    static void draw_indexed_geom(IndexedGeometry<Vert>& geom, u32 object = 0)
     {
+        // left bound, the next draw usually binds its own
         geom.vert_buf.bind_vao();
-        glDrawElements(geom.prim_type, geom.index_buf.get_n_elems(), GL_UNSIGNED_INT, 0);
-        geom.vert_buf.unbind_vao();
+        FrameStatsCounter::count_draw(geom.prim_type, geom.index_buf.get_n_elems());
+        glDrawElementsInstancedBaseInstance(geom.prim_type, geom.index_buf.get_n_elems(),
+                                            geom.index_buf.get_index_type(), 0, 1, object);
+    }
+
+    // Every mesh of an arena draws through the same VAO, so consecutive
+    // draws from one arena don't change any binding. n_streams limits the
+    // draw to the arena's first streams, e.g. 1 for just positions.
+    static void draw_indexed_geom(const GeometryArenaBase& arena, GeometryHandle mesh, u32 object = 0,
+                                  u32 n_streams = ALL_STREAMS)
+    {
+        arena.bind(n_streams);
+        // a draw for each part of a split mesh
+        for (auto& range : arena.get(mesh))
+        {
+            FrameStatsCounter::count_draw(arena.get_prim_type(), range.n_indices);
+            glDrawElementsInstancedBaseVertexBaseInstance(
+                arena.get_prim_type(), range.n_indices, GeometryArenaBase::INDEX_TYPE,
+                (void*)((std::size_t)range.first_index * sizeof(GeometryArenaBase::Index)),
+                1, range.base_vertex, object);
+        }
     }
 
+    // All the draws in one glMultiDrawElementsIndirect, the commands go
+    // through the upload ring. Clears the list, does nothing when it's empty,
+    // so it can be called whenever state is about to change.
+    static void multi_draw_indexed_geom(const GeometryArenaBase& arena, IndirectDrawList& draws,
+                                        u32 n_streams = ALL_STREAMS);
+
     struct SDL
     {
-        SDL(const std::string& win_title, u32 w, u32 h);
+        SDL(const std::string& win_title, u32 w, u32 h, u32 flags);
         ~SDL();
 
         SDL_Window* window;
@@ -98,10 +129,9 @@ public:
 
 private:
 
-    Renderer(const std::string& win_title, u32 w, u32 h);
+    Renderer(const std::string& win_title, u32 w, u32 h, u32 flags);
 
     void send_global_uniforms();
-    void update_material_uniform(f32 roughness, f32 metalness, bool has_normal_map);
 
     SDL sdl;
     std::unique_ptr<Framebuffer> default_framebuffer;
@@ -113,7 +143,7 @@ private:
     f32 near_clip;
     f32 far_clip;
 
-    GLuint global_ubo;
+    std::unique_ptr<UploadRing> upload_ring;
     GlobalUniforms global_uniforms;
 
     static std::unique_ptr<Renderer> renderer;
@@ -0,0 +1,120 @@
+#ifndef SPENNY_RENDERQUEUE_H
+#define SPENNY_RENDERQUEUE_H
+
+#include <cassert>
+#include <vector>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// One draw, as indices into whatever the caller keeps its programs,
+// materials, geometry and per-object data in.
+struct DrawPacket
+{
+    u32 program;
+    u32 material;
+    u32 geometry;
+    u32 object;
+    // Distance from the camera along the view direction, >= 0 in front
+    f32 depth;
+};
+
+enum SortKeyField
+{
+    SortKeyField_Program,
+    SortKeyField_Material,
+    SortKeyField_Geometry,
+    SortKeyField_Depth,
+    // depth flipped, far to near
+    SortKeyField_InvDepth,
+};
+
+// Which packet fields go into the 64-bit sort key, most significant first,
+// and how many bits each gets. Values wider than their field are truncated,
+// so ids that don't fit only sort approximately.
+struct SortKeyLayout
+{
+    static constexpr u32 MAX_FIELDS = 5;
+
+    struct Field
+    {
+        SortKeyField field;
+        u32 bits;
+    };
+
+    Field fields[MAX_FIELDS];
+    u32 n_fields;
+
+    // Depth prepass and other opaque passes that only care about overdraw
+    static constexpr SortKeyLayout front_to_back()
+    {
+        return SortKeyLayout{ { { SortKeyField_Depth, 24 }, { SortKeyField_Program, 12 },
+                                { SortKeyField_Material, 16 }, { SortKeyField_Geometry, 12 } }, 4 };
+    }
+
+    // Fewest program, material and VAO changes, near to far within a state
+    static constexpr SortKeyLayout state()
+    {
+        return SortKeyLayout{ { { SortKeyField_Program, 12 }, { SortKeyField_Material, 16 },
+                                { SortKeyField_Geometry, 16 }, { SortKeyField_Depth, 20 } }, 4 };
+    }
+
+    // Blended passes
+    static constexpr SortKeyLayout back_to_front()
+    {
+        return SortKeyLayout{ { { SortKeyField_InvDepth, 24 }, { SortKeyField_Program, 12 },
+                                { SortKeyField_Material, 16 }, { SortKeyField_Geometry, 12 } }, 4 };
+    }
+};
+
+// Collects the draws of one pass, sorts them by key and hands them back in
+// order. Storage only grows, so once it has seen the largest frame a queue
+// doesn't allocate.
+class RenderQueue
+{
+public:
+    explicit RenderQueue(const SortKeyLayout& layout = SortKeyLayout::state());
+
+    void set_layout(const SortKeyLayout& layout);
+    void reserve(u32 n_packets);
+
+    void clear();
+    void push(const DrawPacket& packet);
+
+    // LSD radix sort on the keys, stable, so equal keys keep push order
+    void sort();
+
+    u32 size() const { return packets.size(); }
+
+    // i-th packet in sorted order, after sort()
+    const DrawPacket& operator[](u32 i) const { return packets[entries[i].packet]; }
+
+    template<typename F>
+    void submit(F&& draw) const
+    {
+        for (auto& entry : entries)
+        {
+            draw(packets[entry.packet]);
+        }
+    }
+
+    u64 encode_key(const DrawPacket& packet) const;
+
+private:
+    struct Entry
+    {
+        u64 key;
+        u32 packet;
+    };
+
+    SortKeyLayout layout;
+    std::vector<DrawPacket> packets;
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+};
+
+} // namespace sr
+
+#endif // SPENNY_RENDERQUEUE_H
@@ -1,7 +1,11 @@
 #ifndef SPENNY_SHADER_H
 #define SPENNY_SHADER_H
 
+#include <cassert>
+#include <cstring>
 #include <string>
+#include <type_traits>
+#include <vector>
 #include <glad/glad.h>
 
 #include "spennymath.h"
@@ -9,24 +13,185 @@
 namespace sr
 {
 
+// A uniform name and its hash. String literals convert implicitly and are
+// hashed at compile time, names only known at runtime go through
+// from_runtime().
+struct UniformName
+{
+    template<usize N>
+    consteval UniformName(const char (&str)[N])
+        : hash(sm::dbj2(str, N - 1)), name(str)
+    {
+    }
+
+    static UniformName from_runtime(const char* str)
+    {
+        return UniformName(sm::dbj2(str, std::strlen(str)), str);
+    }
+
+    u64 hash;
+    const char* name;
+
+private:
+    UniformName(u64 hash, const char* name) : hash(hash), name(name) {}
+};
+
+// Location of a uniform whose GL type has been checked against T once, when
+// the handle was made.
+template<typename T>
+struct UniformHandle
+{
+    GLint location = -1;
+};
+
+enum ProgramStatus
+{
+    ProgramStatus_None,
+    ProgramStatus_Pending,
+    ProgramStatus_Ready,
+    ProgramStatus_Failed,
+};
+
 class Shader
 {
 public:
-    bool load_program(const std::string& vs_src, const std::string& fs_src);
+    // Goes through the ProgramCache when it's enabled. defines are inserted
+    // after the #version line of both sources, and lines of the form
+    // #include "name" are replaced with the shared source added under name.
+    bool load_program(const std::string& vs_src, const std::string& fs_src, const std::string& defines = "");
+
+    // Hands the sources to the driver and returns without waiting for the
+    // compile or link, poll is_ready() to find out when it's done. With
+    // GL_KHR_parallel_shader_compile the driver compiles on its own threads
+    // and is_ready() never blocks. Without it the compile still overlaps
+    // whatever is submitted before the first poll, and that poll blocks
+    // until the program has linked.
+    void load_program_async(const std::string& vs_src, const std::string& fs_src, const std::string& defines = "");
+
+    // Checks the status, reflects and stores the binary the first time it
+    // sees the program finished. Only call between frames or before
+    // use_program, the fallback stops being used as soon as it returns true.
+    bool is_ready();
+    ProgramStatus get_status() const { return status; }
+
+    // Blocks until the program has linked, false if it failed
+    bool wait_ready() { return finish_program(); }
+
+    // Drawn with in place of this program until it's ready. use_program and
+    // the named uniform setters forward to it, handles taken from a program
+    // that isn't ready are the fallback's, so take them again once
+    // is_ready() returns true.
+    void set_fallback(Shader* fallback) { this->fallback = fallback; }
 
     void use_program();
 
-    void set_uniform_mat4(const std::string& name, const sm::Mat4& mat);
-    void set_uniform_vec3(const std::string& name, const sm::Vec3& v3);
-    void set_uniform_int(const std::string& name, const i32 val);
-    void set_uniform_float(const std::string& name, const f32 val);
+    // Uniforms are looked up in the table built at link time, names that
+    // aren't active in the program are ignored like GL does for location -1.
+    void set_uniform_mat4(UniformName name, const sm::Mat4& mat);
+    void set_uniform_vec3(UniformName name, const sm::Vec3& v3);
+    void set_uniform_int(UniformName name, const i32 val);
+    void set_uniform_float(UniformName name, const f32 val);
+
+    // For uniforms set every draw, skips the table lookup
+    template<typename T>
+    UniformHandle<T> get_uniform(UniformName name) const;
+
+    void set_uniform(UniformHandle<sm::Mat4> handle, const sm::Mat4& mat);
+    void set_uniform(UniformHandle<sm::Vec3> handle, const sm::Vec3& v3);
+    void set_uniform(UniformHandle<i32> handle, const i32 val);
+    void set_uniform(UniformHandle<f32> handle, const f32 val);
+
+    GLint get_uniform_location(UniformName name) const;
+
+    // GL_INVALID_INDEX if the program has no such block
+    GLuint get_uniform_block_index(UniformName name) const;
+    void bind_uniform_block(UniformName name, u32 binding);
 
     u32 get_id() const { return id; }
+    // Debug label, for after the program's been loaded
+    void set_label(const char* label);
+    // The program use_program binds, the fallback's until this one is ready
+    u32 get_active_id() const { return active()->id; }
+
+    // GLSL shared between shaders, e.g. the GlobalUniforms block
+    static void add_shared_source(const std::string& name, const std::string& src);
+    static std::string expand_source(const std::string& src, const std::string& defines);
 
 private:
-    GLuint id;
+    // Lookups go by hash, and the name settles it when two names share one
+    struct UniformInfo
+    {
+        u64 hash;
+        std::string name;
+        GLint location;
+        GLenum type;
+    };
+
+    struct UniformBlockInfo
+    {
+        u64 hash;
+        std::string name;
+        GLuint index;
+    };
+
+    void submit_program(const std::string& vs_src, const std::string& fs_src, const std::string& defines);
+    bool finish_program();
+    void reflect();
+    const UniformInfo* find_uniform(UniformName name) const;
+    static bool type_matches(GLenum type, GLenum expected);
+
+    // The program whose uniforms and id are used right now
+    Shader* active() { return status != ProgramStatus_Ready && fallback ? fallback : this; }
+    const Shader* active() const { return status != ProgramStatus_Ready && fallback ? fallback : this; }
+
+    GLuint id = 0;
+    ProgramStatus status = ProgramStatus_None;
+    Shader* fallback = nullptr;
+
+    // Only set while the program is pending
+    GLuint pending_vs = 0;
+    GLuint pending_fs = 0;
+    u64 cache_key = 0;
+    u64 compile_start_ns = 0;
+
+    // sorted by hash
+    std::vector<UniformInfo> uniforms;
+    std::vector<UniformBlockInfo> uniform_blocks;
 };
 
+template<typename T>
+UniformHandle<T> Shader::get_uniform(UniformName name) const
+{
+    GLenum expected;
+    if constexpr (std::is_same_v<T, sm::Mat4>)
+    {
+        expected = GL_FLOAT_MAT4;
+    }
+    else if constexpr (std::is_same_v<T, sm::Vec3>)
+    {
+        expected = GL_FLOAT_VEC3;
+    }
+    else if constexpr (std::is_same_v<T, i32>)
+    {
+        expected = GL_INT;
+    }
+    else
+    {
+        static_assert(std::is_same_v<T, f32>, "No setter for this uniform type");
+        expected = GL_FLOAT;
+    }
+
+    UniformHandle<T> handle;
+    auto* info = active()->find_uniform(name);
+    if (info)
+    {
+        assert(type_matches(info->type, expected) && "Uniform handle type doesn't match the shader");
+        handle.location = info->location;
+    }
+    (void)expected;
+    return handle;
+}
+
 } // namespace sr
 
 
@@ -0,0 +1,79 @@
+#ifndef SPENNY_SHADERVARIANTS_H
+#define SPENNY_SHADERVARIANTS_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader.h"
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Features a variant is specialized for. Each one turns into a #define the
+// sources can test, so a variant only carries the code its materials use.
+// The light count sits in the high bits of the key, 0 keeps the n_lights
+// uniform and the dynamic loop.
+enum ShaderFeature
+{
+    ShaderFeature_None = 0,
+    ShaderFeature_NormalMap = 1 << 0,  // SR_NORMAL_MAP
+    ShaderFeature_AlphaTest = 1 << 1,  // SR_ALPHA_TEST
+
+    ShaderFeature_LightCountShift = 8, // SR_LIGHT_COUNT n
+    ShaderFeature_LightCountMask = 0xff << ShaderFeature_LightCountShift,
+};
+
+inline u32 shader_features_with_lights(u32 features, u32 n_lights)
+{
+    assert(n_lights <= 0xff && "Too many lights for a variant key");
+    return (features & ~ShaderFeature_LightCountMask) | (n_lights << ShaderFeature_LightCountShift);
+}
+
+// The #define lines for a key
+std::string shader_feature_defines(u32 features);
+
+// One vertex/fragment source pair and the variants compiled from it, keyed by
+// their ShaderFeature bitmask. Variants compile asynchronously the first time
+// they're asked for and draw with the fallback until they're ready, or ahead
+// of time from a manifest of the keys a previous run used.
+class ShaderVariants
+{
+public:
+    ShaderVariants(const std::string& vs_src, const std::string& fs_src, Shader* fallback = nullptr);
+
+    // Starts compiling the variant if it's new. Check is_ready() on it, or
+    // call update() once a frame, before relying on its handles.
+    Shader& get(u32 features);
+
+    // Polls the variants still compiling, once a frame between passes
+    void update();
+
+    void prewarm(u32 features) { get(features); }
+    void prewarm(const std::vector<u32>& keys);
+
+    // Blocks until every requested variant has linked, false if any failed
+    bool wait_all();
+
+    // One key per line, as the feature names with the light count last, e.g.
+    // "normal_map lights=4". An empty line is the variant with no features.
+    bool prewarm_from_manifest(const std::string& path);
+    bool write_manifest(const std::string& path) const;
+
+    u32 n_variants() const { return variants.size(); }
+
+private:
+    std::string vs_src;
+    std::string fs_src;
+    Shader* fallback;
+
+    // unique_ptrs so references handed out by get() stay put
+    std::unordered_map<u32, std::unique_ptr<Shader>> variants;
+    std::vector<u32> request_order;
+};
+
+} // namespace sr
+
+#endif // SPENNY_SHADERVARIANTS_H
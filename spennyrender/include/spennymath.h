@@ -8,6 +8,20 @@
 
 #include "spennytypes.h"
 
+// SIMD backend is picked at compile time from the target flags. Define
+// SPENNYMATH_SCALAR to force the scalar reference path everywhere.
+#if !defined(SPENNYMATH_SCALAR)
+#if defined(__AVX2__) && defined(__FMA__)
+#define SPENNYMATH_AVX2
+#define SPENNYMATH_SSE
+#elif defined(__SSE2__) || defined(_M_X64)
+#define SPENNYMATH_SSE
+#endif
+#endif
+
+#if defined(SPENNYMATH_SSE)
+#include <immintrin.h>
+#endif
 
 namespace sm {
 
@@ -86,7 +100,7 @@ struct Vec3
     }
 };
 
-struct Vec4
+struct alignas(16) Vec4
 {
     union
     {
@@ -155,7 +169,7 @@ operator<<(std::ostream& os, Vec4& v)
     return os;
 }
 
-struct Mat4
+struct alignas(16) Mat4
 {
     Vec4 cols[4];
 
@@ -198,18 +212,178 @@ diag(f32 s)
     }};
 }
 
+//--------------------------------------------------------------------------------
+// Scalar reference path
+//
+// These are the straightforward implementations the SIMD kernels below are
+// checked against. The public operators dispatch to the SIMD versions when
+// a backend is available and fall back to these otherwise.
+//--------------------------------------------------------------------------------
+
+namespace scalar
+{
+
 inline Mat4
-transpose(Mat4&& m)
+transpose(const Mat4& m)
 {
     return Mat4
     {{
-        {m[0].x, m[1].x, m[2].x, m[3].x},
-        {m[0].y, m[1].y, m[2].y, m[3].y},
-        {m[0].z, m[1].z, m[2].z, m[3].z},
-        {m[0].w, m[1].w, m[2].w, m[3].w},
+        {m.cols[0].x, m.cols[1].x, m.cols[2].x, m.cols[3].x},
+        {m.cols[0].y, m.cols[1].y, m.cols[2].y, m.cols[3].y},
+        {m.cols[0].z, m.cols[1].z, m.cols[2].z, m.cols[3].z},
+        {m.cols[0].w, m.cols[1].w, m.cols[2].w, m.cols[3].w},
     }};
 }
 
+inline Vec4
+mul(const Mat4& left, const Vec4& right)
+{
+    Vec4 result {0, 0, 0, 0};
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            result.xyzw[row] += left.cols[col].xyzw[row] * right.xyzw[col];
+        }
+    }
+    return result;
+}
+
+inline Mat4
+mul(const Mat4& left, const Mat4& right)
+{
+    Mat4 result{};
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                result.cols[col].xyzw[row] += left.cols[k].xyzw[row] * right.cols[col].xyzw[k];
+            }
+        }
+    }
+    return result;
+}
+
+inline Mat4
+mul(const Mat4& left, const f32 right)
+{
+    Mat4 result = left;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            result.cols[col].xyzw[row] *= right;
+        }
+    }
+    return result;
+}
+
+// Rotation as the product of the individual axis rotations, applied
+// pitch (x) first, then roll (z), then yaw (y).
+inline Mat4
+rotate(f32 pitch, f32 yaw, f32 roll)
+{
+    const float DEG2RAD = acos(-1.0f) / 180;
+    f32 sinp = sin(DEG2RAD * pitch);
+    f32 cosp = cos(DEG2RAD * pitch);
+    f32 siny = sin(DEG2RAD * yaw);
+    f32 cosy = cos(DEG2RAD * yaw);
+    f32 sinr = sin(DEG2RAD * roll);
+    f32 cosr = cos(DEG2RAD * roll);
+
+    Mat4 pitch_m = mat4_I();
+    pitch_m[1][1] = cosp;
+    pitch_m[1][2] = sinp;
+    pitch_m[2][1] = -sinp;
+    pitch_m[2][2] = cosp;
+
+    Mat4 yaw_m = mat4_I();
+    yaw_m[0][0] = cosy;
+    yaw_m[2][0] = siny;
+    yaw_m[0][2] = -siny;
+    yaw_m[2][2] = cosy;
+
+    Mat4 roll_m = mat4_I();
+    roll_m[0][0] = cosr;
+    roll_m[1][0] = -sinr;
+    roll_m[0][1] = sinr;
+    roll_m[1][1] = cosr;
+
+    return mul(mul(yaw_m, roll_m), pitch_m);
+}
+
+} // namespace scalar
+
+//--------------------------------------------------------------------------------
+// SIMD helpers
+//--------------------------------------------------------------------------------
+
+#if defined(SPENNYMATH_SSE)
+namespace simd
+{
+
+inline __m128
+load(const Vec4& v)
+{
+    return _mm_load_ps(v.xyzw);
+}
+
+inline Vec4
+store(__m128 v)
+{
+    Vec4 result;
+    _mm_store_ps(result.xyzw, v);
+    return result;
+}
+
+template<int i>
+inline __m128
+splat(__m128 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i));
+}
+
+// a * b + c, fused when the target has FMA
+inline __m128
+madd(__m128 a, __m128 b, __m128 c)
+{
+#if defined(SPENNYMATH_AVX2)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+inline __m128
+mul(const Mat4& left, __m128 v)
+{
+    __m128 result = _mm_mul_ps(load(left.cols[0]), splat<0>(v));
+    result = madd(load(left.cols[1]), splat<1>(v), result);
+    result = madd(load(left.cols[2]), splat<2>(v), result);
+    result = madd(load(left.cols[3]), splat<3>(v), result);
+    return result;
+}
+
+} // namespace simd
+#endif
+
+inline Mat4
+transpose(const Mat4& m)
+{
+#if defined(SPENNYMATH_SSE)
+    __m128 c0 = simd::load(m.cols[0]);
+    __m128 c1 = simd::load(m.cols[1]);
+    __m128 c2 = simd::load(m.cols[2]);
+    __m128 c3 = simd::load(m.cols[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    return Mat4 {{ simd::store(c0), simd::store(c1), simd::store(c2), simd::store(c3) }};
+#else
+    return scalar::transpose(m);
+#endif
+}
+
 inline Mat4
 from_rows(Vec4 r1, Vec4 r2, Vec4 r3, Vec4 r4)
 {
@@ -247,46 +421,60 @@ operator<<(std::ostream& os, Mat4& mat)
 inline Vec4
 operator*(const Mat4& left, const Vec4& right)
 {
-    Vec4 result {0, 0, 0, 0};
-    for (int n = 0; n < 4; n++)
-    {
-        for (int k = 0; k < 4; k++)
-        {
-            result.xyzw[n] += left.cols[n][k] * right[n];
-        }
-    }
-    return result;
+#if defined(SPENNYMATH_SSE)
+    return simd::store(simd::mul(left, simd::load(right)));
+#else
+    return scalar::mul(left, right);
+#endif
 }
 
 inline Mat4
 operator*(const Mat4& left, const Mat4& right)
 {
-    Mat4 result = {0};
-    for (int m = 0; m < 4; m++)
+#if defined(SPENNYMATH_AVX2)
+    // two result columns per iteration, each 128-bit lane holds one column
+    __m256 l0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(left.cols[0].xyzw));
+    __m256 l1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(left.cols[1].xyzw));
+    __m256 l2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(left.cols[2].xyzw));
+    __m256 l3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(left.cols[3].xyzw));
+
+    Mat4 result;
+    for (int col = 0; col < 4; col += 2)
     {
-        for (int n = 0; n < 4; n++)
-        {
-            for (int k = 0; k < 4; k++)
-            {
-                result[m][n] += left[k][m] * right[n][k];
-            }
-        }
+        __m256 r = _mm256_loadu_ps(right.cols[col].xyzw);
+        __m256 acc = _mm256_mul_ps(l0, _mm256_permute_ps(r, 0x00));
+        acc = _mm256_fmadd_ps(l1, _mm256_permute_ps(r, 0x55), acc);
+        acc = _mm256_fmadd_ps(l2, _mm256_permute_ps(r, 0xAA), acc);
+        acc = _mm256_fmadd_ps(l3, _mm256_permute_ps(r, 0xFF), acc);
+        _mm256_storeu_ps(result.cols[col].xyzw, acc);
     }
     return result;
+#elif defined(SPENNYMATH_SSE)
+    Mat4 result;
+    for (int col = 0; col < 4; col++)
+    {
+        _mm_store_ps(result.cols[col].xyzw, simd::mul(left, simd::load(right.cols[col])));
+    }
+    return result;
+#else
+    return scalar::mul(left, right);
+#endif
 }
 
 inline Mat4
 operator*(const Mat4& left, const f32& right)
 {
-    Mat4 result = left;
-    for (i32 n = 0; n < 4; n++)
+#if defined(SPENNYMATH_SSE)
+    __m128 s = _mm_set1_ps(right);
+    Mat4 result;
+    for (int col = 0; col < 4; col++)
     {
-        for (i32 m = 0; m < 4; m++)
-        {
-            result[m][n] = left[m][n] * right;
-        }
+        _mm_store_ps(result.cols[col].xyzw, _mm_mul_ps(simd::load(left.cols[col]), s));
     }
     return result;
+#else
+    return scalar::mul(left, right);
+#endif
 }
 
 inline Mat4
@@ -294,7 +482,7 @@ translation_by(Vec3 by)
 {
     Mat4 result = mat4_I();
 
-    result.cols[3] = Vec4 { by.x, by.y, by.x, 1.0 };
+    result.cols[3] = Vec4 { by.x, by.y, by.z, 1.0 };
 
     return result;
 }
@@ -322,6 +510,8 @@ scale_by(Vec3 by)
     return result;
 }
 
+// Same rotation as scalar::rotate, with the product of the three axis
+// matrices written out instead of computed.
 inline Mat4
 rotate(f32 pitch, f32 yaw, f32 roll)
 {
@@ -333,25 +523,35 @@ rotate(f32 pitch, f32 yaw, f32 roll)
     f32 sinr = sin(DEG2RAD * roll);
     f32 cosr = cos(DEG2RAD * roll);
 
-    Mat4 pitch_m = mat4_I();
-    pitch_m[1][1] = cosp;
-    pitch_m[1][2] = sinp;
-    pitch_m[2][1] = -sinp;
-    pitch_m[2][2] = cosp;
+#if defined(SPENNYMATH_SSE)
+    // every column is a y-rotation of a roll/pitch column
+    __m128 yaw_x = _mm_setr_ps(cosy, 0, -siny, 0);
+    __m128 yaw_z = _mm_setr_ps(siny, 0, cosy, 0);
+    __m128 up    = _mm_setr_ps(0, 1, 0, 0);
 
-    Mat4 yaw_m = mat4_I();
-    yaw_m[0][0] = cosy;
-    yaw_m[2][0] = siny;
-    yaw_m[0][2] = -siny;
-    yaw_m[2][2] = cosy;
-
-    Mat4 roll_m = mat4_I();
-    roll_m[0][0] = cosr;
-    roll_m[1][0] = -sinr;
-    roll_m[0][1] = sinr;
-    roll_m[1][1] = cosr;
+    auto column = [&](f32 x, f32 y, f32 z)
+    {
+        __m128 c = _mm_mul_ps(yaw_x, _mm_set1_ps(x));
+        c = simd::madd(up, _mm_set1_ps(y), c);
+        return simd::store(simd::madd(yaw_z, _mm_set1_ps(z), c));
+    };
 
-    return yaw_m * roll_m * pitch_m;
+    return Mat4
+    {{
+        column(cosr, sinr, 0),
+        column(-sinr * cosp, cosr * cosp, sinp),
+        column(sinr * sinp, -cosr * sinp, cosp),
+        {0, 0, 0, 1},
+    }};
+#else
+    return Mat4
+    {{
+        {cosy * cosr, sinr, -siny * cosr, 0},
+        {-cosy * sinr * cosp + siny * sinp, cosr * cosp, siny * sinr * cosp + cosy * sinp, 0},
+        {cosy * sinr * sinp + siny * cosp, -cosr * sinp, -siny * sinr * sinp + cosy * cosp, 0},
+        {0, 0, 0, 1},
+    }};
+#endif
 }
 
 //--------------------------------------------------------------------------------
@@ -498,13 +698,21 @@ operator==(const Vec3& lhs, const Vec3& rhs)
 inline Vec4
 operator+(const Vec4& lhs, const Vec4& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_add_ps(simd::load(lhs), simd::load(rhs)));
+#else
     return Vec4 { lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z, lhs.w + rhs.w };
+#endif
 }
 
 inline Vec4
 operator+(const Vec4& lhs, const f32 rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_add_ps(simd::load(lhs), _mm_set1_ps(rhs)));
+#else
     return Vec4 { lhs.x + rhs, lhs.y + rhs, lhs.z + rhs, lhs.w + rhs };
+#endif
 }
 
 inline Vec4
@@ -517,19 +725,31 @@ operator+(const f32 lhs, const Vec4 rhs)
 inline Vec4
 operator-(const Vec4& lhs, const Vec4& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_sub_ps(simd::load(lhs), simd::load(rhs)));
+#else
     return Vec4 { lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z, lhs.w - rhs.w };
+#endif
 }
 
 inline Vec4
 operator-(const Vec4& lhs, const f32& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_sub_ps(simd::load(lhs), _mm_set1_ps(rhs)));
+#else
     return Vec4 { lhs.x - rhs, lhs.y - rhs, lhs.z - rhs, lhs.w - rhs };
+#endif
 }
 
 inline Vec4
 operator-(const f32& lhs, const Vec4& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_sub_ps(_mm_set1_ps(lhs), simd::load(rhs)));
+#else
     return Vec4 { lhs - rhs.x, lhs - rhs.y, lhs - rhs.z, lhs - rhs.w };
+#endif
 }
 
 // Multiplication by a scalar. NO vector/vector mult,
@@ -537,7 +757,11 @@ operator-(const f32& lhs, const Vec4& rhs)
 inline Vec4
 operator*(const Vec4& lhs, const f32& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_mul_ps(simd::load(lhs), _mm_set1_ps(rhs)));
+#else
     return Vec4 { lhs.x * rhs, lhs.y * rhs, lhs.z * rhs, lhs.w * rhs };
+#endif
 }
 
 inline Vec4
@@ -549,7 +773,11 @@ operator*(const f32& lhs, const Vec4& rhs)
 inline Vec4
 operator/(const Vec4& lhs, const f32& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_div_ps(simd::load(lhs), _mm_set1_ps(rhs)));
+#else
     return Vec4 { lhs.x / rhs, lhs.y / rhs, lhs.z / rhs, lhs.w / rhs};
+#endif
 }
 
 inline f32
@@ -591,7 +819,11 @@ hadamard(const Vec3& lhs, const Vec3& rhs)
 inline Vec4
 hadamard(const Vec4& lhs, const Vec4& rhs)
 {
+#if defined(SPENNYMATH_SSE)
+    return simd::store(_mm_mul_ps(simd::load(lhs), simd::load(rhs)));
+#else
     return Vec4 { lhs.x * rhs.x, lhs.y * rhs.y, lhs.z * rhs.z, lhs.w * rhs.w };
+#endif
 }
 
 
@@ -737,8 +969,10 @@ round(f32 val)
 
 // 3D camera stuff
 
-inline Mat4
-look_at(const Vec3& pos, const Vec3& target, Vec3 up = {0, 1, 0})
+// Orthonormal camera basis for look_at. Returns right, up and the
+// direction the camera looks away from (+z in view space).
+inline void
+look_at_basis(const Vec3& pos, const Vec3& target, Vec3 up, Vec3* right, Vec3* real_up, Vec3* back)
 {
     auto view_dir = norm(target - pos);
 
@@ -755,20 +989,62 @@ look_at(const Vec3& pos, const Vec3& target, Vec3 up = {0, 1, 0})
         }
     }
 
-    auto right = norm(cross(view_dir, up));
-    auto real_up = norm(cross(right, view_dir));
+    *right = norm(cross(view_dir, up));
+    *real_up = norm(cross(*right, view_dir));
+    *back = -1.0f * view_dir;
+}
 
-    Mat4 pmat = mat4_I();
-    pmat[0][3] = -pos.x;
-    pmat[1][3] = -pos.y;
-    pmat[2][3] = -pos.z;
+namespace scalar
+{
+
+// View matrix as rotation * translation.
+inline Mat4
+look_at(const Vec3& pos, const Vec3& target, Vec3 up = {0, 1, 0})
+{
+    Vec3 right, real_up, back;
+    look_at_basis(pos, target, up, &right, &real_up, &back);
 
-    Mat4 basis = { extend(right, 0),
-                   extend(real_up, 0),
-                   extend(-1.0f * view_dir, 0),
-                   Vec4{0, 0, 0, 1} };
+    Mat4 tmat = translation_by(-1.0f * pos);
+    Mat4 basis = from_rows(extend(right, 0),
+                           extend(real_up, 0),
+                           extend(back, 0),
+                           Vec4{0, 0, 0, 1});
 
-    return pmat * basis;
+    return mul(basis, tmat);
+}
+
+} // namespace scalar
+
+inline Mat4
+look_at(const Vec3& pos, const Vec3& target, Vec3 up = {0, 1, 0})
+{
+    Vec3 right, real_up, back;
+    look_at_basis(pos, target, up, &right, &real_up, &back);
+
+#if defined(SPENNYMATH_SSE)
+    Mat4 result;
+    __m128 c0 = _mm_setr_ps(right.x, right.y, right.z, 0);
+    __m128 c1 = _mm_setr_ps(real_up.x, real_up.y, real_up.z, 0);
+    __m128 c2 = _mm_setr_ps(back.x, back.y, back.z, 0);
+    __m128 c3 = _mm_setr_ps(0, 0, 0, 1);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_store_ps(result.cols[0].xyzw, c0);
+    _mm_store_ps(result.cols[1].xyzw, c1);
+    _mm_store_ps(result.cols[2].xyzw, c2);
+    _mm_store_ps(result.cols[3].xyzw, c3);
+
+    // the rotation has no translation yet, so this is rot * (-pos, 1)
+    _mm_store_ps(result.cols[3].xyzw, simd::mul(result, _mm_setr_ps(-pos.x, -pos.y, -pos.z, 1)));
+    return result;
+#else
+    return Mat4
+    {{
+        {right.x, real_up.x, back.x, 0},
+        {right.y, real_up.y, back.y, 0},
+        {right.z, real_up.z, back.z, 0},
+        {-dot(right, pos), -dot(real_up, pos), -dot(back, pos), 1},
+    }};
+#endif
 }
 
 inline Mat4
@@ -781,7 +1057,7 @@ perspective(const f32 fovy, const f32 aspect_ratio, const f32 front = 0.1, const
     float right = top * aspect_ratio;          // half width of near plane
 
     // params: left, right, bottom, top, near(front), far(back)
-    Mat4 matrix = {0};
+    Mat4 matrix{};
     matrix[0][0]  =  front / right;
     matrix[1][1]  =  front / top;
     matrix[2][2] = -(back + front) / (back - front);
@@ -791,13 +1067,299 @@ perspective(const f32 fovy, const f32 aspect_ratio, const f32 front = 0.1, const
     return matrix;
 }
 
-inline u64
+//--------------------------------------------------------------------------------
+// Affine helpers
+//--------------------------------------------------------------------------------
+
+// Inverse of a matrix whose last row is (0, 0, 0, 1), i.e. any combination of
+// translation, rotation and scale. The 3x3 part is inverted with the cross
+// product form, so this is a few dozen flops instead of a general 4x4 inverse.
+inline Mat4
+affine_inverse(const Mat4& m)
+{
+    Vec3 a = { m.cols[0].x, m.cols[0].y, m.cols[0].z };
+    Vec3 b = { m.cols[1].x, m.cols[1].y, m.cols[1].z };
+    Vec3 c = { m.cols[2].x, m.cols[2].y, m.cols[2].z };
+    Vec3 t = { m.cols[3].x, m.cols[3].y, m.cols[3].z };
+
+    Vec3 r0 = cross(b, c);
+    Vec3 r1 = cross(c, a);
+    Vec3 r2 = cross(a, b);
+    f32 det = dot(a, r0);
+    assert(det != 0 && "singular matrix");
+    f32 inv_det = 1.0f / det;
+    r0 = r0 * inv_det;
+    r1 = r1 * inv_det;
+    r2 = r2 * inv_det;
+
+    return Mat4
+    {{
+        {r0.x, r1.x, r2.x, 0},
+        {r0.y, r1.y, r2.y, 0},
+        {r0.z, r1.z, r2.z, 0},
+        {-dot(r0, t), -dot(r1, t), -dot(r2, t), 1},
+    }};
+}
+
+// transpose(inverse(mat3(m))) padded out to a Mat4, for transforming normals
+// and tangents. Upload it as a mat4 and take mat3() of it in the shader.
+inline Mat4
+normal_matrix(const Mat4& m)
+{
+    Vec3 a = { m.cols[0].x, m.cols[0].y, m.cols[0].z };
+    Vec3 b = { m.cols[1].x, m.cols[1].y, m.cols[1].z };
+    Vec3 c = { m.cols[2].x, m.cols[2].y, m.cols[2].z };
+
+    Vec3 c0 = cross(b, c);
+    Vec3 c1 = cross(c, a);
+    Vec3 c2 = cross(a, b);
+    f32 det = dot(a, c0);
+    assert(det != 0 && "singular matrix");
+    f32 inv_det = 1.0f / det;
+
+    return Mat4
+    {{
+        extend(c0 * inv_det, 0),
+        extend(c1 * inv_det, 0),
+        extend(c2 * inv_det, 0),
+        {0, 0, 0, 1},
+    }};
+}
+
+//--------------------------------------------------------------------------------
+// Quaternions
+//--------------------------------------------------------------------------------
+
+struct alignas(16) Quat
+{
+    f32 x;
+    f32 y;
+    f32 z;
+    f32 w;
+};
+
+inline Quat
+quat_I()
+{
+    return Quat { 0, 0, 0, 1 };
+}
+
+// angle is in degrees, like rotate()
+inline Quat
+quat_axis_angle(Vec3 axis, f32 angle)
+{
+    const float DEG2RAD = acos(-1.0f) / 180;
+    f32 half = angle * DEG2RAD * 0.5f;
+    f32 sin_half = sin(half);
+    f32 cos_half = cos(half);
+    Vec3 v = norm(axis) * sin_half;
+    return Quat { v.x, v.y, v.z, cos_half };
+}
+
+inline Quat
+operator*(const Quat& lhs, const Quat& rhs)
+{
+    return Quat
+    {
+        lhs.w * rhs.x + lhs.x * rhs.w + lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.w * rhs.y - lhs.x * rhs.z + lhs.y * rhs.w + lhs.z * rhs.x,
+        lhs.w * rhs.z + lhs.x * rhs.y - lhs.y * rhs.x + lhs.z * rhs.w,
+        lhs.w * rhs.w - lhs.x * rhs.x - lhs.y * rhs.y - lhs.z * rhs.z,
+    };
+}
+
+// Same rotation as rotate(pitch, yaw, roll)
+inline Quat
+quat_euler(f32 pitch, f32 yaw, f32 roll)
+{
+    return quat_axis_angle(Vec3{0, 1, 0}, yaw)
+         * quat_axis_angle(Vec3{0, 0, 1}, roll)
+         * quat_axis_angle(Vec3{1, 0, 0}, pitch);
+}
+
+inline f32
+dot(const Quat& lhs, const Quat& rhs)
+{
+    return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z + lhs.w * rhs.w;
+}
+
+inline Quat
+conjugate(const Quat& q)
+{
+    return Quat { -q.x, -q.y, -q.z, q.w };
+}
+
+inline Quat
+norm(Quat q)
+{
+    f32 l = sqrt(dot(q, q));
+    assert(l > 0 && "kablam");
+    return Quat { q.x / l, q.y / l, q.z / l, q.w / l };
+}
+
+// Rotate v by the unit quaternion q
+inline Vec3
+operator*(const Quat& q, const Vec3& v)
+{
+    Vec3 u = { q.x, q.y, q.z };
+    Vec3 t = 2.0f * cross(u, v);
+    return v + q.w * t + cross(u, t);
+}
+
+inline Mat4
+to_mat4(const Quat& q)
+{
+    f32 xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    f32 xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    f32 wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    return Mat4
+    {{
+        {1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0},
+        {2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0},
+        {2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0},
+        {0, 0, 0, 1},
+    }};
+}
+
+// Normalized lerp along the shortest arc. Cheap and good enough when the
+// two rotations are close, e.g. consecutive animation keys.
+inline Quat
+nlerp(const Quat& a, Quat b, f32 t)
+{
+    if (dot(a, b) < 0)
+    {
+        b = Quat { -b.x, -b.y, -b.z, -b.w };
+    }
+    return norm(Quat { a.x + (b.x - a.x) * t,
+                       a.y + (b.y - a.y) * t,
+                       a.z + (b.z - a.z) * t,
+                       a.w + (b.w - a.w) * t });
+}
+
+inline Quat
+slerp(const Quat& a, Quat b, f32 t)
+{
+    f32 cos_theta = dot(a, b);
+    if (cos_theta < 0)
+    {
+        b = Quat { -b.x, -b.y, -b.z, -b.w };
+        cos_theta = -cos_theta;
+    }
+
+    // nearly parallel, the sin below would blow up
+    if (cos_theta > 0.9995f)
+    {
+        return nlerp(a, b, t);
+    }
+
+    f32 theta = acos(cos_theta);
+    f32 inv_sin = 1.0f / sin(theta);
+    f32 wa = sin((1 - t) * theta) * inv_sin;
+    f32 wb = sin(t * theta) * inv_sin;
+    return Quat { a.x * wa + b.x * wb,
+                  a.y * wa + b.y * wb,
+                  a.z * wa + b.z * wb,
+                  a.w * wa + b.w * wb };
+}
+
+//--------------------------------------------------------------------------------
+// Transforms
+//--------------------------------------------------------------------------------
+
+// Translation, rotation and scale, applied scale first. Composition and
+// inverse are exact for uniform scale; with non-uniform scale under a
+// rotation the result can't be represented as TRS and shear is dropped.
+struct Transform
+{
+    Vec3 translation;
+    Quat rotation;
+    Vec3 scale;
+};
+
+inline Transform
+transform_I()
+{
+    return Transform { Vec3{0, 0, 0}, quat_I(), Vec3{1, 1, 1} };
+}
+
+inline Vec3
+transform_point(const Transform& t, const Vec3& p)
+{
+    return t.translation + t.rotation * hadamard(t.scale, p);
+}
+
+inline Vec3
+transform_direction(const Transform& t, const Vec3& d)
+{
+    return t.rotation * hadamard(t.scale, d);
+}
+
+// parent * child applies child first
+inline Transform
+operator*(const Transform& parent, const Transform& child)
+{
+    return Transform
+    {
+        transform_point(parent, child.translation),
+        norm(parent.rotation * child.rotation),
+        hadamard(parent.scale, child.scale),
+    };
+}
+
+inline Transform
+inverse(const Transform& t)
+{
+    Vec3 inv_scale = { 1.0f / t.scale.x, 1.0f / t.scale.y, 1.0f / t.scale.z };
+    Quat inv_rot = conjugate(t.rotation);
+    return Transform
+    {
+        -1.0f * hadamard(inv_scale, inv_rot * t.translation),
+        inv_rot,
+        inv_scale,
+    };
+}
+
+inline Transform
+lerp(const Transform& a, const Transform& b, f32 t)
+{
+    return Transform
+    {
+        a.translation + (b.translation - a.translation) * t,
+        slerp(a.rotation, b.rotation, t),
+        a.scale + (b.scale - a.scale) * t,
+    };
+}
+
+inline Mat4
+to_mat4(const Transform& t)
+{
+    Mat4 result = to_mat4(t.rotation);
+    result.cols[0] = result.cols[0] * t.scale.x;
+    result.cols[1] = result.cols[1] * t.scale.y;
+    result.cols[2] = result.cols[2] * t.scale.z;
+    result.cols[3] = extend(t.translation, 1);
+    return result;
+}
+
+// Same as normal_matrix(to_mat4(t)) without the 3x3 inverse
+inline Mat4
+normal_matrix(const Transform& t)
+{
+    Mat4 result = to_mat4(t.rotation);
+    result.cols[0] = result.cols[0] * (1.0f / t.scale.x);
+    result.cols[1] = result.cols[1] * (1.0f / t.scale.y);
+    result.cols[2] = result.cols[2] * (1.0f / t.scale.z);
+    return result;
+}
+
+constexpr u64
 dbj2(const char* str, usize len)
 {
     u64 hash = 5381;
     for (usize i = 0; i < len && str[i]; i++)
     {
-        hash = ((hash << 5) + hash) * str[i];
+        hash = ((hash << 5) + hash) + (u8)str[i];
     }
     return hash;
 }
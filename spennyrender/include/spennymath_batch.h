@@ -0,0 +1,283 @@
+#ifndef SPENNYMATH_BATCH_H
+#define SPENNYMATH_BATCH_H
+
+#include <span>
+
+#include "spennymath.h"
+#include "spennytypes.h"
+
+// Batched transforms over structure-of-arrays data. Everything here works on
+// blocks of 8 lanes so a block maps onto one AVX register per component. When
+// AVX2 isn't available the same loops run per lane and are left to the
+// compiler to vectorize.
+
+namespace sm {
+
+constexpr usize BATCH_LANES = 8;
+
+struct alignas(32) Vec3x8
+{
+    f32 x[BATCH_LANES];
+    f32 y[BATCH_LANES];
+    f32 z[BATCH_LANES];
+};
+
+struct alignas(32) Vec4x8
+{
+    f32 x[BATCH_LANES];
+    f32 y[BATCH_LANES];
+    f32 z[BATCH_LANES];
+    f32 w[BATCH_LANES];
+};
+
+// Number of 8-lane blocks needed to hold n elements.
+constexpr usize
+batch_blocks(usize n)
+{
+    return (n + BATCH_LANES - 1) / BATCH_LANES;
+}
+
+//--------------------------------------------------------------------------------
+// Packing
+//--------------------------------------------------------------------------------
+
+// Unused lanes in the last block are zeroed.
+inline void
+pack(std::span<const Vec3> in, std::span<Vec3x8> out)
+{
+    assert(out.size() >= batch_blocks(in.size()) && "not enough blocks");
+    for (usize block = 0; block < batch_blocks(in.size()); block++)
+    {
+        Vec3x8& dst = out[block];
+        for (usize lane = 0; lane < BATCH_LANES; lane++)
+        {
+            usize i = block * BATCH_LANES + lane;
+            Vec3 v = (i < in.size()) ? in[i] : Vec3{0, 0, 0};
+            dst.x[lane] = v.x;
+            dst.y[lane] = v.y;
+            dst.z[lane] = v.z;
+        }
+    }
+}
+
+inline void
+unpack(std::span<const Vec3x8> in, std::span<Vec3> out)
+{
+    assert(in.size() >= batch_blocks(out.size()) && "not enough blocks");
+    for (usize i = 0; i < out.size(); i++)
+    {
+        const Vec3x8& src = in[i / BATCH_LANES];
+        usize lane = i % BATCH_LANES;
+        out[i] = Vec3{src.x[lane], src.y[lane], src.z[lane]};
+    }
+}
+
+//--------------------------------------------------------------------------------
+// Scalar reference kernels
+//--------------------------------------------------------------------------------
+
+namespace scalar
+{
+
+// w is 1 for points and 0 for directions
+inline void
+transform(const Mat4& m, std::span<const Vec3x8> in, std::span<Vec3x8> out, f32 w)
+{
+    assert(out.size() >= in.size() && "output too small");
+    const Vec4* c = m.cols;
+    for (usize block = 0; block < in.size(); block++)
+    {
+        const Vec3x8& src = in[block];
+        Vec3x8& dst = out[block];
+        for (usize lane = 0; lane < BATCH_LANES; lane++)
+        {
+            f32 x = src.x[lane];
+            f32 y = src.y[lane];
+            f32 z = src.z[lane];
+            dst.x[lane] = c[0].x * x + c[1].x * y + c[2].x * z + c[3].x * w;
+            dst.y[lane] = c[0].y * x + c[1].y * y + c[2].y * z + c[3].y * w;
+            dst.z[lane] = c[0].z * x + c[1].z * y + c[2].z * z + c[3].z * w;
+        }
+    }
+}
+
+inline void
+transform(const Mat4& m, std::span<const Vec4x8> in, std::span<Vec4x8> out)
+{
+    assert(out.size() >= in.size() && "output too small");
+    const Vec4* c = m.cols;
+    for (usize block = 0; block < in.size(); block++)
+    {
+        const Vec4x8& src = in[block];
+        Vec4x8& dst = out[block];
+        for (usize lane = 0; lane < BATCH_LANES; lane++)
+        {
+            f32 x = src.x[lane];
+            f32 y = src.y[lane];
+            f32 z = src.z[lane];
+            f32 w = src.w[lane];
+            dst.x[lane] = c[0].x * x + c[1].x * y + c[2].x * z + c[3].x * w;
+            dst.y[lane] = c[0].y * x + c[1].y * y + c[2].y * z + c[3].y * w;
+            dst.z[lane] = c[0].z * x + c[1].z * y + c[2].z * z + c[3].z * w;
+            dst.w[lane] = c[0].w * x + c[1].w * y + c[2].w * z + c[3].w * w;
+        }
+    }
+}
+
+} // namespace scalar
+
+//--------------------------------------------------------------------------------
+// AVX2 kernels
+//--------------------------------------------------------------------------------
+
+#if defined(SPENNYMATH_AVX2)
+namespace simd
+{
+
+// one matrix element broadcast across all 8 lanes
+struct Mat4x8
+{
+    __m256 m[4][4];
+
+    explicit Mat4x8(const Mat4& mat)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                m[col][row] = _mm256_set1_ps(mat.cols[col].xyzw[row]);
+            }
+        }
+    }
+
+    template<int row>
+    __m256 dot(__m256 x, __m256 y, __m256 z) const
+    {
+        __m256 r = _mm256_mul_ps(m[0][row], x);
+        r = _mm256_fmadd_ps(m[1][row], y, r);
+        return _mm256_fmadd_ps(m[2][row], z, r);
+    }
+
+    template<int row>
+    __m256 dot(__m256 x, __m256 y, __m256 z, __m256 w) const
+    {
+        return _mm256_fmadd_ps(m[3][row], w, dot<row>(x, y, z));
+    }
+};
+
+inline void
+transform_points(const Mat4& mat, std::span<const Vec3x8> in, std::span<Vec3x8> out)
+{
+    Mat4x8 m(mat);
+    for (usize block = 0; block < in.size(); block++)
+    {
+        __m256 x = _mm256_load_ps(in[block].x);
+        __m256 y = _mm256_load_ps(in[block].y);
+        __m256 z = _mm256_load_ps(in[block].z);
+        _mm256_store_ps(out[block].x, _mm256_add_ps(m.dot<0>(x, y, z), m.m[3][0]));
+        _mm256_store_ps(out[block].y, _mm256_add_ps(m.dot<1>(x, y, z), m.m[3][1]));
+        _mm256_store_ps(out[block].z, _mm256_add_ps(m.dot<2>(x, y, z), m.m[3][2]));
+    }
+}
+
+inline void
+transform_directions(const Mat4& mat, std::span<const Vec3x8> in, std::span<Vec3x8> out)
+{
+    Mat4x8 m(mat);
+    for (usize block = 0; block < in.size(); block++)
+    {
+        __m256 x = _mm256_load_ps(in[block].x);
+        __m256 y = _mm256_load_ps(in[block].y);
+        __m256 z = _mm256_load_ps(in[block].z);
+        _mm256_store_ps(out[block].x, m.dot<0>(x, y, z));
+        _mm256_store_ps(out[block].y, m.dot<1>(x, y, z));
+        _mm256_store_ps(out[block].z, m.dot<2>(x, y, z));
+    }
+}
+
+inline void
+transform(const Mat4& mat, std::span<const Vec4x8> in, std::span<Vec4x8> out)
+{
+    Mat4x8 m(mat);
+    for (usize block = 0; block < in.size(); block++)
+    {
+        __m256 x = _mm256_load_ps(in[block].x);
+        __m256 y = _mm256_load_ps(in[block].y);
+        __m256 z = _mm256_load_ps(in[block].z);
+        __m256 w = _mm256_load_ps(in[block].w);
+        _mm256_store_ps(out[block].x, m.dot<0>(x, y, z, w));
+        _mm256_store_ps(out[block].y, m.dot<1>(x, y, z, w));
+        _mm256_store_ps(out[block].z, m.dot<2>(x, y, z, w));
+        _mm256_store_ps(out[block].w, m.dot<3>(x, y, z, w));
+    }
+}
+
+} // namespace simd
+#endif
+
+//--------------------------------------------------------------------------------
+// Batch API
+//
+// in and out may be the same span. Sizes are checked once per call, not per
+// element.
+//--------------------------------------------------------------------------------
+
+inline void
+transform_points(const Mat4& m, std::span<const Vec3x8> in, std::span<Vec3x8> out)
+{
+    assert(out.size() >= in.size() && "output too small");
+#if defined(SPENNYMATH_AVX2)
+    simd::transform_points(m, in, out);
+#else
+    scalar::transform(m, in, out, 1.0f);
+#endif
+}
+
+inline void
+transform_directions(const Mat4& m, std::span<const Vec3x8> in, std::span<Vec3x8> out)
+{
+    assert(out.size() >= in.size() && "output too small");
+#if defined(SPENNYMATH_AVX2)
+    simd::transform_directions(m, in, out);
+#else
+    scalar::transform(m, in, out, 0.0f);
+#endif
+}
+
+inline void
+transform(const Mat4& m, std::span<const Vec4x8> in, std::span<Vec4x8> out)
+{
+    assert(out.size() >= in.size() && "output too small");
+#if defined(SPENNYMATH_AVX2)
+    simd::transform(m, in, out);
+#else
+    scalar::transform(m, in, out);
+#endif
+}
+
+// out[i] = left * right[i], e.g. a parent transform applied to its children
+inline void
+mul(const Mat4& left, std::span<const Mat4> right, std::span<Mat4> out)
+{
+    assert(out.size() >= right.size() && "output too small");
+    for (usize i = 0; i < right.size(); i++)
+    {
+        out[i] = left * right[i];
+    }
+}
+
+// out[i] = left[i] * right[i]
+inline void
+mul(std::span<const Mat4> left, std::span<const Mat4> right, std::span<Mat4> out)
+{
+    assert(left.size() == right.size() && "mismatched batch sizes");
+    assert(out.size() >= left.size() && "output too small");
+    for (usize i = 0; i < left.size(); i++)
+    {
+        out[i] = left[i] * right[i];
+    }
+}
+
+} // namespace sm
+
+#endif // SPENNYMATH_BATCH_H
@@ -0,0 +1,83 @@
+#ifndef SPENNY_STRESSSCENE_H
+#define SPENNY_STRESSSCENE_H
+
+#include <vector>
+
+#include "model.h"
+#include "spennymath.h"
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Procedurally generated scenes for scaling tests. Everything is derived
+// from the seed, so the same config always produces the same scene.
+
+struct PointLight
+{
+    sm::Vec3 position;
+    sm::Vec3 color;
+};
+
+struct MeshInstance
+{
+    u32 mesh;
+    MaterialIndex material;
+    sm::Transform transform;
+};
+
+struct StressSceneConfig
+{
+    u32 seed = 1;
+
+    // Unique generated meshes. Ignored when instancing a source model.
+    u32 n_meshes = 16;
+    // Rings per generated mesh, the mesh has 2 * detail segments per ring.
+    u32 mesh_detail = 16;
+
+    u32 n_instances = 1000;
+    u32 n_materials = 16;
+    u32 n_textures = 8;
+    u32 texture_size = 256;
+    u32 n_lights = 4;
+
+    // Instances are scattered over a square of this side length.
+    f32 extent = 100.0f;
+};
+
+struct StressScene
+{
+    Model model;
+    std::vector<MeshInstance> instances;
+    std::vector<PointLight> lights;
+
+    // Texture data at mip 0
+    u64 texture_bytes;
+
+    // Vertex and index data of the unique meshes
+    u64 geometry_bytes() const;
+};
+
+enum StressSceneFlags
+{
+    StressSceneFlags_None = 0,
+    // Don't create textures, usable without a GL context.
+    StressSceneFlags_NoTextures = 1 << 0,
+};
+
+class StressSceneGenerator
+{
+public:
+    // Generates meshes, materials, textures, instances and lights.
+    static StressScene generate(const StressSceneConfig& config, u32 flags = StressSceneFlags_None);
+
+    // Instances the meshes of an existing model instead of generating new
+    // ones, e.g. 100k foxes. Lights are still generated from the config.
+    // With n_materials == 0 every instance keeps its mesh's material from
+    // the source model, otherwise materials are generated too.
+    static StressScene generate(const StressSceneConfig& config, const Model& source, u32 flags = StressSceneFlags_None);
+};
+
+} // namespace sr
+
+#endif // SPENNY_STRESSSCENE_H
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <glad/glad.h>
+#include "glstate.h"
 #include "spennytypes.h"
 #include "shader.h"
 
@@ -31,6 +32,8 @@ public:
 
     GLuint get_id() const noexcept;
 
+    void set_label(const char* label);
+
 private:
     friend class TextureBuilder;
     i32 w;
@@ -106,7 +109,7 @@ public:
         glGenTextures(1, &id);
         assert(id && "id was bad?");
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+        GLState::bind_texture(GL_TEXTURE_CUBE_MAP, id);
 
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -114,7 +117,7 @@ public:
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLState::bind_texture(GL_TEXTURE_CUBE_MAP, 0);
     }
 
     void buffer_face(i32 face, i32 w, i32 h, const u8* data);
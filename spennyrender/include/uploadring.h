@@ -0,0 +1,88 @@
+#ifndef SPENNY_UPLOADRING_H
+#define SPENNY_UPLOADRING_H
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+#include "spennytypes.h"
+
+namespace sr
+{
+
+// Space handed out by UploadRing, valid until the end of the frame it was
+// allocated in. ptr is write-only memory the GPU sees without a flush.
+struct UploadAlloc
+{
+    u8* ptr;
+    GLuint buffer;
+    std::size_t offset;
+    std::size_t size;
+};
+
+// A buffer mapped once, persistently and coherently, split into one region
+// per frame in flight. Each frame writes into its own region, and a fence
+// at the end of the frame keeps the CPU from coming back to the region
+// until the GPU is done reading it. That caps the CPU at n_frames ahead and
+// means no upload ever waits on a draw.
+//
+// A frame that needs more than a region grows the ring. Allocations already
+// made stay where they are, the old buffer is deleted once the GPU is past
+// the frames that used it.
+class UploadRing
+{
+public:
+    static constexpr u32 DEFAULT_FRAMES = 3;
+
+    UploadRing(std::size_t bytes_per_frame, u32 n_frames = DEFAULT_FRAMES);
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    // Waits until the GPU has finished the frame that last used the next
+    // region, then starts allocating from it
+    void begin_frame();
+    // Fences the region, nothing allocated this frame can be used after
+    void end_frame();
+
+    // alignment has to be a power of two
+    UploadAlloc allocate(std::size_t bytes, std::size_t alignment);
+    UploadAlloc upload(const void* data, std::size_t bytes, std::size_t alignment);
+
+    // Binds the allocation to an indexed target like GL_UNIFORM_BUFFER
+    static void bind_range(GLenum target, u32 index, const UploadAlloc& alloc);
+
+    // Offset alignments the driver needs for binding ranges
+    std::size_t get_uniform_alignment() const { return uniform_alignment; }
+    std::size_t get_storage_alignment() const { return storage_alignment; }
+
+    std::size_t get_bytes_per_frame() const { return region_size; }
+    u32 get_n_frames() const { return n_frames; }
+
+private:
+    struct Retired
+    {
+        GLuint buffer;
+        u64 frame;
+    };
+
+    void create_buffer(std::size_t bytes_per_frame);
+    void grow(std::size_t min_bytes_per_frame);
+
+    GLuint buffer;
+    u8* mapped;
+    std::size_t region_size;
+    u32 n_frames;
+    std::size_t uniform_alignment;
+    std::size_t storage_alignment;
+
+    u64 frame_index;
+    // bytes used in the current frame's region
+    std::size_t head;
+    std::vector<GLsync> fences;
+    std::vector<Retired> retired;
+};
+
+} // namespace sr
+
+#endif // SPENNY_UPLOADRING_H
@@ -1,23 +1,34 @@
 #ifndef VERTBUF_H_
 #define VERTBUF_H_
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 // TODO: would be nice to decouple this
 #include <glad/glad.h>
 
+#include "gldebug.h"
+#include "glstate.h"
 #include "spennytypes.h"
 
 namespace sr
 {
 
-template <typename T, u32 n, u32 gl_type>
+// Integer components read as floats in the shader. Normalized ones map the
+// type's range to [0, 1], or [-1, 1] when it's signed, the others convert
+// the value as is. size is only different for packed types.
+template <typename T, u32 n, u32 gl_type, bool normalized = false, u32 size = sizeof(T) * n>
 struct VertexComponent
 {
     using Type = T;
     static constexpr u32 N = n;
     static constexpr u32 GLType = gl_type;
-    static constexpr u32 Size = sizeof(T) * n;
+    static constexpr bool Normalized = normalized;
+    static constexpr u32 Size = size;
 };
 
 template<u32 N>
@@ -29,6 +40,27 @@ using S32Component = VertexComponent<i32, N, GL_INT>;
 template<u32 N>
 using U32Component = VertexComponent<u32, N, GL_UNSIGNED_INT>;
 
+// IEEE half floats, see float_to_half in vertpack.h
+template<u32 N>
+using F16Component = VertexComponent<u16, N, GL_HALF_FLOAT>;
+
+template<u32 N>
+using UNorm8Component = VertexComponent<u8, N, GL_UNSIGNED_BYTE, true>;
+
+template<u32 N>
+using SNorm8Component = VertexComponent<i8, N, GL_BYTE, true>;
+
+template<u32 N>
+using UNorm16Component = VertexComponent<u16, N, GL_UNSIGNED_SHORT, true>;
+
+template<u32 N>
+using SNorm16Component = VertexComponent<i16, N, GL_SHORT, true>;
+
+// x, y and z in 10 bits each and w in 2, from the low bits up, read as a
+// vec4. See pack_snorm_1010102 in vertpack.h.
+using SNorm1010102Component = VertexComponent<u32, 4, GL_INT_2_10_10_10_REV, true, 4>;
+using UNorm1010102Component = VertexComponent<u32, 4, GL_UNSIGNED_INT_2_10_10_10_REV, true, 4>;
+
 template <typename... Components>
 struct BufferLayout{};
 
@@ -51,74 +83,238 @@ struct Tail<BufferLayout<First, Rest...>>
     using Type = BufferLayout<Rest...>;
 };
 
+// Identifies a vertex format, e.g. for pipeline state. Vertices with the
+// same components in the same order and the same stride share a key.
+template<typename L>
+constexpr u64 buffer_layout_key(u64 hash = 0xcbf29ce484222325ull)
+{
+    if constexpr (std::is_same<BufferLayout<>, L>())
+    {
+        return hash;
+    }
+    else
+    {
+        using Attr = typename FirstComponent<L>::Type;
+        const u64 PRIME = 0x100000001b3ull;
+        hash = (hash ^ Attr::GLType) * PRIME;
+        hash = (hash ^ Attr::N) * PRIME;
+        hash = (hash ^ Attr::Normalized) * PRIME;
+        return buffer_layout_key<typename Tail<L>::Type>(hash);
+    }
+}
+
+// Vertex data split over several buffers. Each stream is a struct with its
+// own Layout, like a single buffer vertex, and attribute locations carry on
+// from one stream to the next, so shaders see the same inputs whether the
+// streams are split or interleaved. Put the position first: binding only the
+// first few streams is how depth-only passes skip the rest.
+template<typename... Streams>
+struct VertexStreams{};
+
+template <typename First, typename... Rest>
+struct Tail<VertexStreams<First, Rest...>>
+{
+    using Type = VertexStreams<Rest...>;
+};
+
+// Drawing with every stream of a format, see VertexBuffer::bind_vao
+constexpr u32 ALL_STREAMS = 0xFFFFFFFF;
+
+// A plain vertex struct is a format with one stream
+template<typename Vert>
+struct StreamsOf
+{
+    using Type = VertexStreams<Vert>;
+};
+
+template<typename... Streams>
+struct StreamsOf<VertexStreams<Streams...>>
+{
+    using Type = VertexStreams<Streams...>;
+};
+
+template<typename S>
+struct StreamInfo{};
+
+template<typename... Streams>
+struct StreamInfo<VertexStreams<Streams...>>
+{
+    static constexpr u32 COUNT = sizeof...(Streams);
+    static constexpr u32 STRIDES[] = { (u32)sizeof(Streams)... };
+
+    template<u32 I>
+    using At = std::tuple_element_t<I, std::tuple<Streams...>>;
+};
+
+template<typename L>
+constexpr u32 layout_n_components()
+{
+    if constexpr (std::is_same<BufferLayout<>, L>())
+    {
+        return 0;
+    }
+    else
+    {
+        return 1 + layout_n_components<typename Tail<L>::Type>();
+    }
+}
+
+template<typename S>
+constexpr u64 streams_layout_key(u64 hash)
+{
+    if constexpr (std::is_same<VertexStreams<>, S>())
+    {
+        return hash;
+    }
+    else
+    {
+        using Stream = typename StreamInfo<S>::template At<0>;
+        hash = (buffer_layout_key<typename Stream::Layout>(hash) ^ sizeof(Stream)) * 0x100000001b3ull;
+        return streams_layout_key<typename Tail<S>::Type>(hash);
+    }
+}
+
+template<typename Vert>
+constexpr u64 vertex_layout_key()
+{
+    return streams_layout_key<typename StreamsOf<Vert>::Type>(0xcbf29ce484222325ull);
+}
+
+// Sets up the bound VAO's attributes for the layout through
+// GL_ARB_vertex_attrib_binding, all reading from one vertex buffer binding.
+// The buffer itself is attached separately with glBindVertexBuffer, so
+// changing or moving it leaves the formats alone.
+template<typename L>
+void configure_attrib_formats(u32 binding, u32 attr_num = 0, u32 offset = 0)
+{
+    if constexpr (std::is_same<BufferLayout<>, L>())
+    {
+        return;
+    }
+    else
+    {
+        using Attr = typename FirstComponent<L>::Type;
+
+        glVertexAttribFormat(attr_num, Attr::N, Attr::GLType, Attr::Normalized, offset);
+        glVertexAttribBinding(attr_num, binding);
+        glEnableVertexAttribArray(attr_num);
+
+        configure_attrib_formats<typename Tail<L>::Type>(binding, attr_num + 1, offset + Attr::Size);
+    }
+}
+
+// The first n_streams streams of the format, stream i reading from vertex
+// buffer binding i. The other streams' attributes stay disabled.
+template<typename Vert>
+void configure_stream_formats(u32 n_streams, u32 binding = 0, u32 attr_num = 0)
+{
+    using S = typename StreamsOf<Vert>::Type;
+    if constexpr (!std::is_same<VertexStreams<>, S>())
+    {
+        if (binding >= n_streams)
+        {
+            return;
+        }
+        using Layout = typename StreamInfo<S>::template At<0>::Layout;
+        configure_attrib_formats<Layout>(binding, attr_num);
+        configure_stream_formats<typename Tail<S>::Type>(n_streams, binding + 1,
+                                                         attr_num + layout_n_components<Layout>());
+    }
+}
+
+// One buffer per stream of Vert. There's a VAO for every prefix of the
+// streams, bind_vao(1) gets one that only reads the first.
 template<typename Vert>
 class VertexBuffer
 {
-    using Layout = typename Vert::Layout;
+    using Streams = typename StreamsOf<Vert>::Type;
+    static constexpr u32 N_STREAMS = StreamInfo<Streams>::COUNT;
 public:
 
     VertexBuffer()
     {
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glGenVertexArrays(N_STREAMS, vaos);
+        glGenBuffers(N_STREAMS, vbos);
 
-        configure_attributes<Layout>();
-
-        glBindVertexArray(0);
+        for (u32 i = 0; i < N_STREAMS; i++)
+        {
+            GLState::bind_vertex_array(vaos[i]);
+            configure_stream_formats<Vert>(i + 1);
+            for (u32 j = 0; j <= i; j++)
+            {
+                glBindVertexBuffer(j, vbos[j], 0, StreamInfo<Streams>::STRIDES[j]);
+            }
+        }
     }
 
+    // For single stream formats
     void buffer_data(const Vert* data, u64 n_verts, u32 mem_type = GL_STATIC_DRAW)
     {
-        glBindVertexArray(vao);
+        static_assert(N_STREAMS == 1, "Split vertex formats are buffered with buffer_stream");
+        buffer_stream<0>(data, n_verts, mem_type);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, n_verts * sizeof(Vert), data, mem_type);
+    template<u32 I>
+    void buffer_stream(const typename StreamInfo<Streams>::template At<I>* data, u64 n_verts,
+                       u32 mem_type = GL_STATIC_DRAW)
+    {
+        buffer_bytes(I, data, n_verts, mem_type);
+    }
 
-        glBindVertexArray(0);
+    // n_verts zeroed vertices in every stream
+    void buffer_zeroed(u64 n_verts, u32 mem_type = GL_STATIC_DRAW)
+    {
+        for (u32 i = 0; i < N_STREAMS; i++)
+        {
+            std::vector<u8> zeros(n_verts * StreamInfo<Streams>::STRIDES[i]);
+            buffer_bytes(i, zeros.data(), n_verts, mem_type);
+        }
     }
 
-    void bind_vao()
+    // Reads only the first n_streams streams
+    void bind_vao(u32 n_streams = ALL_STREAMS)
     {
-        glBindVertexArray(vao);
+        GLState::bind_vertex_array(get_vao(n_streams));
     }
 
     void unbind_vao()
     {
-        glBindVertexArray(0);
+        GLState::bind_vertex_array(0);
     }
 
-private:
-    template<typename L>
-    void configure_attributes(u32 attr_num = 0, u64 offset = 0)
+    GLuint get_vao(u32 n_streams = ALL_STREAMS) const
     {
-        if constexpr (std::is_same<BufferLayout<>, L>())
-        {
-            return;
-        }
-        else
+        assert(n_streams > 0 && "A VAO needs at least one stream");
+        return vaos[std::min(n_streams, N_STREAMS) - 1];
+    }
+
+    void set_label(const char* label)
+    {
+        for (u32 i = 0; i < N_STREAMS; i++)
         {
-            using Attr = typename FirstComponent<L>::Type;
-            u32 stride = sizeof(Vert);
-
-            glVertexAttribPointer(attr_num,
-                                  Attr::N,
-                                  Attr::GLType,
-                                  GL_FALSE,
-                                  stride,
-                                  (void*)offset);
-            glEnableVertexAttribArray(attr_num);
-
-            configure_attributes<typename Tail<L>::Type>(attr_num + 1, offset + Attr::Size);
+            SR_GL_LABEL(GL_VERTEX_ARRAY, vaos[i], label);
+            SR_GL_LABEL(GL_BUFFER, vbos[i], label);
         }
+        (void)label;
     }
 
-    GLuint vao;
-    GLuint vbo;
+private:
+    void buffer_bytes(u32 stream, const void* data, u64 n_verts, u32 mem_type)
+    {
+        // the array buffer binding isn't VAO state, no need for the VAO
+        GLState::bind_buffer(GL_ARRAY_BUFFER, vbos[stream]);
+        glBufferData(GL_ARRAY_BUFFER, n_verts * StreamInfo<Streams>::STRIDES[stream], data, mem_type);
+    }
+
+    GLuint vaos[N_STREAMS];
+    GLuint vbos[N_STREAMS];
 };
 
+// Largest vertex count 16 bit indices can address
+constexpr u32 MAX_U16_INDEXED_VERTS = 1 << 16;
+
+// Stores indices as u16 whenever they all fit, u32 otherwise, draws have to
+// use get_index_type()
 class IndexBuffer
 {
 public:
@@ -127,9 +323,26 @@ public:
         glGenBuffers(1, &ebo);
     }
 
-    void buffer_indices(u32* indices, u64 count, u32 mem_type = GL_STATIC_DRAW)
+    // Goes to the bound VAO's element array buffer
+    void buffer_indices(const u32* indices, u64 count, u32 mem_type = GL_STATIC_DRAW)
     {
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(u32), indices, mem_type);
+        u32 max_index = 0;
+        for (u64 i = 0; i < count; i++)
+        {
+            max_index = std::max(max_index, indices[i]);
+        }
+
+        if (max_index < MAX_U16_INDEXED_VERTS)
+        {
+            std::vector<u16> narrow(indices, indices + count);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(u16), narrow.data(), mem_type);
+            index_type = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(u32), indices, mem_type);
+            index_type = GL_UNSIGNED_INT;
+        }
         n_elems = count;
     }
 
@@ -148,9 +361,22 @@ public:
         return n_elems;
     }
 
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum get_index_type() const noexcept
+    {
+        return index_type;
+    }
+
+    void set_label(const char* label)
+    {
+        SR_GL_LABEL(GL_BUFFER, ebo, label);
+        (void)label;
+    }
+
 private:
     GLuint ebo;
-    u64 n_elems;
+    u64 n_elems = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
 };
 
 template<typename Vertex>
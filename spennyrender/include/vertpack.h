@@ -0,0 +1,100 @@
+#ifndef SPENNY_VERTPACK_H
+#define SPENNY_VERTPACK_H
+
+#include <vector>
+
+#include "model.h"
+#include "spennymath.h"
+#include "spennytypes.h"
+#include "vertbuf.h"
+
+namespace sr
+{
+
+// Round to nearest even, out of range values become infinity
+u16 float_to_half(f32 value);
+
+// Clamped to the normalized range first
+i16 pack_snorm16(f32 value);
+u16 pack_unorm16(f32 value);
+// For SNorm1010102Component, w only keeps its sign
+u32 pack_snorm_1010102(const sm::Vec4& value);
+
+// A unit vector folded onto the octahedron and flattened to [-1, 1]^2
+sm::Vec2 oct_encode(const sm::Vec3& n);
+sm::Vec3 oct_decode(const sm::Vec2& e);
+
+// Position quantized to 16 bits over the mesh's bounds, w unused. Its own
+// stream, so depth-only passes read 8 bytes a vertex.
+struct PackedPosition
+{
+    using Layout = BufferLayout<UNorm16Component<4>>;
+
+    u16 pos[4];
+};
+static_assert(sizeof(PackedPosition) == 8, "PackedPosition has to match its layout");
+
+// The rest of the vertex, only read when shading:
+// - octahedral normal
+// - tangent with the bitangent's handedness in w, the bitangent is
+//   cross(normal, tangent) * w
+// - half float uv
+struct PackedAttributes
+{
+    using Layout = BufferLayout<SNorm16Component<2>,
+                                SNorm1010102Component,
+                                F16Component<2>>;
+
+    i16 norm[2];
+    u32 tan;
+    u16 uv[2];
+};
+static_assert(sizeof(PackedAttributes) == 12, "PackedAttributes has to match its layout");
+
+// 20 bytes against Vertex's 56, over two streams
+using PackedVertex = VertexStreams<PackedPosition, PackedAttributes>;
+// what depth-only passes bind
+using PackedPositionOnly = VertexStreams<PackedPosition>;
+
+struct PackedVertices
+{
+    std::vector<PackedPosition> positions;
+    std::vector<PackedAttributes> attributes;
+    // takes the quantized positions, [0, 1] across the bounds, back to the
+    // mesh's space, goes in front of the model's own transform
+    sm::Mat4 dequantize;
+};
+
+PackedVertices pack_vertices(const std::vector<Vertex>& verts);
+
+// PackedVertex's attributes for vertex shaders, with #include "packed_vertex".
+// vertex_position() is still quantized, the object's model_to_world has to
+// include PackedVertices::dequantize. Fine for depth-only shaders too, inputs
+// a shader doesn't use don't need their stream bound.
+inline const char* PACKED_VERTEX_GLSL = R"SRC(
+layout (location = 0) in vec4 packed_position;
+layout (location = 1) in vec2 packed_normal;
+layout (location = 2) in vec4 packed_tangent;
+layout (location = 3) in vec2 packed_uv;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+
+vec3 vertex_position() { return packed_position.xyz; }
+vec3 vertex_normal() { return oct_decode(packed_normal); }
+// w is the bitangent's sign
+vec4 vertex_tangent() { return vec4(normalize(packed_tangent.xyz), packed_tangent.w < 0.0 ? -1.0 : 1.0); }
+vec2 vertex_uv() { return packed_uv; }
+)SRC";
+
+} // namespace sr
+
+#endif // SPENNY_VERTPACK_H
@@ -0,0 +1,263 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include "alloctrack.h"
+
+namespace sr
+{
+
+#ifdef SPENNY_TRACK_ALLOCS
+
+namespace
+{
+
+// Trivially constructible so the thread_local needs no init guard, the hooks
+// can run before anything else on a new thread.
+struct ThreadAllocState
+{
+    AllocStats stats;
+    AllocStats frame_begin;
+    u32 tag;
+    bool guarded;
+};
+
+thread_local ThreadAllocState thread_state;
+
+struct TagCounters
+{
+    const char* name;
+    std::atomic<u64> allocs;
+    std::atomic<u64> bytes;
+};
+
+TagCounters tags[AllocTracker::MAX_TAGS] = { { "untagged", {0}, {0} } };
+std::atomic<u32> n_registered_tags{1};
+std::mutex tags_lock;
+
+// Frame guard, only touched from the rendering thread
+u32 guard_warmup = 0;
+bool guard_requested = false;
+u64 guard_frames = 0;
+AllocStats last_frame_stats{};
+
+u32 find_or_add_tag(const char* name)
+{
+    std::lock_guard<std::mutex> lock(tags_lock);
+    u32 n = n_registered_tags.load(std::memory_order_relaxed);
+    for (u32 i = 0; i < n; i++)
+    {
+        if (tags[i].name == name || !std::strcmp(tags[i].name, name))
+        {
+            return i;
+        }
+    }
+    if (n == AllocTracker::MAX_TAGS)
+    {
+        // out of tags, lump it in with the rest
+        return 0;
+    }
+    tags[n].name = name;
+    n_registered_tags.store(n + 1, std::memory_order_release);
+    return n;
+}
+
+void count_alloc(std::size_t size)
+{
+    auto& t = thread_state;
+    t.stats.allocs++;
+    t.stats.bytes += size;
+    tags[t.tag].allocs.fetch_add(1, std::memory_order_relaxed);
+    tags[t.tag].bytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (t.guarded)
+    {
+        // disarm first, reporting may allocate
+        t.guarded = false;
+        std::fprintf(stderr, "AllocTracker: %zu byte heap allocation during frame %llu\n",
+                     size, (unsigned long long)guard_frames);
+        std::abort();
+    }
+}
+
+void* tracked_alloc(std::size_t size)
+{
+    count_alloc(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* tracked_aligned_alloc(std::size_t size, std::align_val_t align)
+{
+    count_alloc(size);
+    std::size_t a = static_cast<std::size_t>(align);
+    // aligned_alloc wants a multiple of the alignment
+    return std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a);
+}
+
+void tracked_free(void* ptr)
+{
+    if (ptr)
+    {
+        thread_state.stats.frees++;
+        std::free(ptr);
+    }
+}
+
+} // namespace
+
+bool AllocTracker::enabled()
+{
+    return true;
+}
+
+AllocStats AllocTracker::thread_stats()
+{
+    return thread_state.stats;
+}
+
+u32 AllocTracker::n_tags()
+{
+    return n_registered_tags.load(std::memory_order_acquire);
+}
+
+const char* AllocTracker::tag_name(u32 tag)
+{
+    return tags[tag].name;
+}
+
+AllocStats AllocTracker::tag_stats(u32 tag)
+{
+    // frees can't be traced back to a tag without a header per allocation
+    return AllocStats{ tags[tag].allocs.load(std::memory_order_relaxed), 0, tags[tag].bytes.load(std::memory_order_relaxed) };
+}
+
+void AllocTracker::set_frame_guard(u32 warmup_frames)
+{
+    guard_requested = true;
+    guard_warmup = warmup_frames;
+    guard_frames = 0;
+}
+
+void AllocTracker::begin_frame()
+{
+    thread_state.frame_begin = thread_state.stats;
+    thread_state.guarded = guard_requested && guard_frames >= guard_warmup;
+}
+
+void AllocTracker::end_frame()
+{
+    thread_state.guarded = false;
+    auto& begin = thread_state.frame_begin;
+    auto& now = thread_state.stats;
+    last_frame_stats = AllocStats{ now.allocs - begin.allocs, now.frees - begin.frees, now.bytes - begin.bytes };
+    guard_frames++;
+}
+
+AllocStats AllocTracker::last_frame()
+{
+    return last_frame_stats;
+}
+
+AllocTagScope::AllocTagScope(const char* name)
+    : prev_tag(thread_state.tag)
+{
+    thread_state.tag = find_or_add_tag(name);
+}
+
+AllocTagScope::~AllocTagScope()
+{
+    thread_state.tag = prev_tag;
+}
+
+#else
+
+bool AllocTracker::enabled() { return false; }
+AllocStats AllocTracker::thread_stats() { return AllocStats{}; }
+u32 AllocTracker::n_tags() { return 0; }
+const char* AllocTracker::tag_name(u32) { return "untagged"; }
+AllocStats AllocTracker::tag_stats(u32) { return AllocStats{}; }
+void AllocTracker::set_frame_guard(u32) {}
+void AllocTracker::begin_frame() {}
+void AllocTracker::end_frame() {}
+AllocStats AllocTracker::last_frame() { return AllocStats{}; }
+
+AllocTagScope::AllocTagScope(const char*) : prev_tag(0) {}
+AllocTagScope::~AllocTagScope() {}
+
+#endif // SPENNY_TRACK_ALLOCS
+
+} // namespace sr
+
+#ifdef SPENNY_TRACK_ALLOCS
+
+// Replacements for the global allocation functions. They live in the same
+// object as AllocTracker, which the renderer always references, so they get
+// linked in from the static library.
+
+void* operator new(std::size_t size)
+{
+    void* ptr = sr::tracked_alloc(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return sr::tracked_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return sr::tracked_alloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    void* ptr = sr::tracked_aligned_alloc(size, align);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return sr::tracked_aligned_alloc(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return sr::tracked_aligned_alloc(size, align);
+}
+
+void operator delete(void* ptr) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { sr::tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { sr::tracked_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { sr::tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { sr::tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { sr::tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { sr::tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { sr::tracked_free(ptr); }
+
+#endif // SPENNY_TRACK_ALLOCS
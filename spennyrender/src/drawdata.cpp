@@ -0,0 +1,53 @@
+#include "drawdata.h"
+#include "profiler.h"
+
+namespace sr
+{
+
+void DrawData::reserve(u32 n_objects, u32 n_materials)
+{
+    objects.reserve(n_objects);
+    materials.reserve(n_materials);
+}
+
+void DrawData::clear()
+{
+    objects.clear();
+    materials.clear();
+}
+
+u32 DrawData::push_material(const Material& material)
+{
+    materials.push_back(MaterialData{
+        material.roughness,
+        material.metallic,
+        material.normals.get_id() != 0 ? 1.0f : 0.0f,
+        material.alpha_cutoff,
+    });
+    return materials.size() - 1;
+}
+
+u32 DrawData::push_object(const sm::Mat4& model_to_world, const sm::Mat4& normal_to_world, u32 material)
+{
+    objects.push_back(ObjectData{ model_to_world, normal_to_world, material, {} });
+    return objects.size() - 1;
+}
+
+void DrawData::upload(UploadRing& ring)
+{
+    SR_PROFILE_SCOPE("DrawData::upload");
+    upload_array(ring, OBJECT_BINDING, objects.data(), objects.size() * sizeof(ObjectData), sizeof(ObjectData));
+    upload_array(ring, MATERIAL_BINDING, materials.data(), materials.size() * sizeof(MaterialData), sizeof(MaterialData));
+}
+
+void DrawData::upload_array(UploadRing& ring, u32 binding, const void* data, std::size_t bytes, std::size_t min_bytes)
+{
+    // an empty range can't be bound, an empty frame still gets one entry
+    // that nothing reads
+    UploadAlloc alloc = bytes > 0
+        ? ring.upload(data, bytes, ring.get_storage_alignment())
+        : ring.allocate(min_bytes, ring.get_storage_alignment());
+    UploadRing::bind_range(GL_SHADER_STORAGE_BUFFER, binding, alloc);
+}
+
+} // namespace sr
@@ -1,6 +1,10 @@
 #include <glad/glad.h>
 
+#include <string>
+
 #include "framebuf.h"
+#include "gldebug.h"
+#include "glstate.h"
 #include "texture.h"
 
 namespace sr
@@ -9,8 +13,11 @@ namespace sr
 Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_attachments, bool use_depth_attachement, bool multisample)
 {
     Framebuffer result;
+    result.format = RenderTargetFormat{};
+    // TextureBuilder's default sample count
+    result.format.samples = multisample ? 4 : 0;
     glGenFramebuffers(1, &result.m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, result.m_fbo);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, result.m_fbo);
     GLuint tex_target = multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
 
     for (u32 i = 0; i < n_color_attachments; i++)
@@ -24,6 +31,7 @@ Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_a
                 .with_data_type(GL_FLOAT)
                 .with_type(tex_target)
                 .build_into(tex);
+        result.format.color[result.format.n_color++] = GL_RGBA16F;
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, tex_target, tex.get_id(), 0);
     }
@@ -38,16 +46,19 @@ Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_a
                     .with_data_type(GL_FLOAT)
                     .with_type(tex_target)
                     .build_into(result.m_depth_attachment);
+        result.format.depth = GL_DEPTH_COMPONENT32F;
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex_target, result.m_depth_attachment.get_id(), 0);
     }
 
+#ifdef SPENNY_RENDER_DEBUG
     auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE)
     {
-        std::cout << "Framebuffer was NOT complete, it was " << status << std::endl;
+        std::cerr << "Framebuffer was NOT complete, it was " << status << std::endl;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+#endif
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
 
     result.width = width;
     result.height = height;
@@ -57,8 +68,12 @@ Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_a
 Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_attachments, Texture depth_attachment, bool multisample)
 {
     Framebuffer result;
+    result.format = RenderTargetFormat{};
+    result.format.samples = multisample ? 4 : 0;
+    // the only depth format the other overload makes
+    result.format.depth = GL_DEPTH_COMPONENT32F;
     glGenFramebuffers(1, &result.m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, result.m_fbo);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, result.m_fbo);
     GLuint tex_target = multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
 
     for (u32 i = 0; i < n_color_attachments; i++)
@@ -71,6 +86,7 @@ Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_a
                 .with_src_format(GL_RGBA)
                 .with_type(tex_target)
                 .build_into(tex);
+        result.format.color[result.format.n_color++] = GL_RGBA8;
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, tex_target, tex.get_id(), 0);
     }
 
@@ -78,12 +94,14 @@ Framebuffer Framebuffer::create_framebuffer(u32 width, u32 height, u32 n_color_a
     // TODO: assert that the depth buffer is correctly multisampled
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex_target, result.m_depth_attachment.get_id(), 0);
 
+#ifdef SPENNY_RENDER_DEBUG
     auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE)
     {
-        std::cout << "Framebuffer was NOT complete, it was " << status << std::endl;
+        std::cerr << "Framebuffer was NOT complete, it was " << status << std::endl;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+#endif
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
 
     result.width = width;
     result.height = height;
@@ -97,13 +115,13 @@ void Framebuffer::clear(u32 what)
 
 void Framebuffer::bind()
 {
-    glViewport(0, 0, width, height);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    GLState::viewport(0, 0, width, height);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, m_fbo);
 }
 
 void Framebuffer::unbind()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
 Texture Framebuffer::get_depth_buffer()
@@ -119,13 +137,31 @@ Texture Framebuffer::get_color_attachment(u32 index)
 
 void Framebuffer::resolve_to(Framebuffer& target)
 {
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.m_fbo);
+    GLState::bind_framebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    GLState::bind_framebuffer(GL_DRAW_FRAMEBUFFER, target.m_fbo);
     glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 
     unbind();
 }
 
+void Framebuffer::set_label(const char* label)
+{
+#ifdef SPENNY_RENDER_DEBUG
+    GLDebug::label(GL_FRAMEBUFFER, m_fbo, label);
+    std::string name(label);
+    for (u32 i = 0; i < format.n_color; i++)
+    {
+        GLDebug::label(GL_TEXTURE, m_color_attachments[i].get_id(), (name + ".color" + std::to_string(i)).c_str());
+    }
+    if (format.depth != 0)
+    {
+        GLDebug::label(GL_TEXTURE, m_depth_attachment.get_id(), (name + ".depth").c_str());
+    }
+#else
+    (void)label;
+#endif
+}
+
 void Framebuffer::put_color_attachment(Texture attachment, u32 attachment_no, u32 type)
 {
     assert(attachment_no < 8 && "Bad attachment number");
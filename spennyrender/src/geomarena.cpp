@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "geomarena.h"
+#include "gldebug.h"
+#include "profiler.h"
+
+namespace sr
+{
+
+GeometryArenaBase::GeometryArenaBase(const u32* strides, u32 n_streams, u32 vertex_capacity,
+                                     u32 index_capacity, GLenum prim_type)
+    : n_streams_total(n_streams)
+      , prim_type(prim_type)
+      , vertex_capacity(vertex_capacity)
+      , index_capacity(index_capacity)
+      , used_verts(0)
+      , used_indices(0)
+{
+    assert(vertex_capacity > 0 && index_capacity > 0 && "Geometry arena can't start empty");
+    assert(n_streams > 0 && n_streams <= MAX_STREAMS && "Geometry arena stream count out of range");
+
+    glGenVertexArrays(n_streams, vaos);
+    for (u32 i = 0; i < n_streams; i++)
+    {
+        this->strides[i] = strides[i];
+        vbos[i] = create_buffer((std::size_t)vertex_capacity * strides[i], "GeometryArena vertices");
+    }
+    ebo = create_buffer((std::size_t)index_capacity * sizeof(Index), "GeometryArena indices");
+    attach_buffers();
+
+    free_verts.push_back(Block{ 0, vertex_capacity });
+    free_indices.push_back(Block{ 0, index_capacity });
+}
+
+GLuint GeometryArenaBase::create_buffer(std::size_t bytes, const char* label)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    // the copy targets aren't cached by GLState, or part of the VAO
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    // immutable, meshes go in with glBufferSubData and the buffers are
+    // only ever replaced whole
+    glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    SR_GL_LABEL(GL_BUFFER, buffer, label);
+    (void)label;
+    return buffer;
+}
+
+void GeometryArenaBase::attach_buffers()
+{
+    // stream i reads from vertex buffer binding i
+    for (u32 i = 0; i < n_streams_total; i++)
+    {
+        GLState::bind_vertex_array(vaos[i]);
+        for (u32 j = 0; j <= i; j++)
+        {
+            glBindVertexBuffer(j, vbos[j], 0, strides[j]);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    }
+}
+
+bool GeometryArenaBase::take(std::vector<Block>& free_list, u32 size, u32& start)
+{
+    for (auto it = free_list.begin(); it != free_list.end(); it++)
+    {
+        if (it->size < size)
+        {
+            continue;
+        }
+        start = it->start;
+        it->start += size;
+        it->size -= size;
+        if (it->size == 0)
+        {
+            free_list.erase(it);
+        }
+        return true;
+    }
+    return false;
+}
+
+void GeometryArenaBase::give_back(std::vector<Block>& free_list, Block block)
+{
+    if (block.size == 0)
+    {
+        return;
+    }
+    auto it = std::lower_bound(free_list.begin(), free_list.end(), block,
+                               [](const Block& a, const Block& b) { return a.start < b.start; });
+    it = free_list.insert(it, block);
+
+    auto next = it + 1;
+    if (next != free_list.end() && it->start + it->size == next->start)
+    {
+        it->size += next->size;
+        free_list.erase(next);
+    }
+    if (it != free_list.begin())
+    {
+        auto prev = it - 1;
+        if (prev->start + prev->size == it->start)
+        {
+            prev->size += it->size;
+            free_list.erase(it);
+        }
+    }
+}
+
+void GeometryArenaBase::grow_vertices(u32 min_capacity)
+{
+    SR_PROFILE_SCOPE("GeometryArena::grow");
+    u32 capacity = std::max(vertex_capacity * 2, min_capacity);
+
+    for (u32 i = 0; i < n_streams_total; i++)
+    {
+        GLuint buffer = create_buffer((std::size_t)capacity * strides[i], "GeometryArena vertices");
+        glBindBuffer(GL_COPY_READ_BUFFER, vbos[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            (std::size_t)vertex_capacity * strides[i]);
+        glDeleteBuffers(1, &vbos[i]);
+        vbos[i] = buffer;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    // deleting unbinds them, the cache doesn't know that
+    GLState::invalidate();
+
+    give_back(free_verts, Block{ vertex_capacity, capacity - vertex_capacity });
+    vertex_capacity = capacity;
+    attach_buffers();
+}
+
+void GeometryArenaBase::grow_indices(u32 min_capacity)
+{
+    SR_PROFILE_SCOPE("GeometryArena::grow");
+    u32 capacity = std::max(index_capacity * 2, min_capacity);
+
+    GLuint buffer = create_buffer((std::size_t)capacity * sizeof(Index), "GeometryArena indices");
+    glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (std::size_t)index_capacity * sizeof(Index));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &ebo);
+    GLState::invalidate();
+
+    ebo = buffer;
+    give_back(free_indices, Block{ index_capacity, capacity - index_capacity });
+    index_capacity = capacity;
+    attach_buffers();
+}
+
+void GeometryArenaBase::reserve(u32 n_verts, u32 n_indices)
+{
+    if (n_verts > vertex_capacity)
+    {
+        grow_vertices(n_verts);
+    }
+    if (n_indices > index_capacity)
+    {
+        grow_indices(n_indices);
+    }
+}
+
+GeometryArenaBase::SplitMesh GeometryArenaBase::split(u32 n_verts, const u32* indices, u32 n_indices) const
+{
+    SplitMesh mesh;
+    mesh.indices.reserve(n_indices);
+    if (n_verts <= MAX_U16_INDEXED_VERTS)
+    {
+        mesh.indices.assign(indices, indices + n_indices);
+        mesh.pieces.push_back(GeometryRange{ 0, n_verts, 0, n_indices });
+        return mesh;
+    }
+
+    // whole primitives go into a piece until the next one would take it
+    // over the limit, vertices are copied into every piece that uses them
+    u32 prim_size = prim_type == GL_TRIANGLES ? 3 : prim_type == GL_LINES ? 2 : 1;
+    assert((prim_type == GL_TRIANGLES || prim_type == GL_LINES || prim_type == GL_POINTS)
+           && "Only point, line and triangle lists can be split for 16 bit indices");
+    assert(n_indices % prim_size == 0 && "Mesh has a partial primitive");
+
+    // piece_of for a vertex no piece has used yet
+    constexpr u32 NO_PIECE = 0xFFFFFFFF;
+    std::vector<u32> piece_of(n_verts, NO_PIECE);
+    std::vector<u32> local(n_verts);
+    u32 piece_index = 0;
+    GeometryRange piece{ 0, 0, 0, 0 };
+    for (u32 i = 0; i < n_indices; i += prim_size)
+    {
+        // a vertex used twice in the primitive is counted twice, closing the
+        // piece a little early at worst
+        u32 new_verts = 0;
+        for (u32 j = 0; j < prim_size; j++)
+        {
+            new_verts += piece_of[indices[i + j]] != piece_index;
+        }
+        if (piece.n_verts + new_verts > MAX_U16_INDEXED_VERTS)
+        {
+            mesh.pieces.push_back(piece);
+            piece = GeometryRange{ piece.base_vertex + piece.n_verts, 0, piece.first_index + piece.n_indices, 0 };
+            piece_index++;
+        }
+
+        for (u32 j = 0; j < prim_size; j++)
+        {
+            u32 vert = indices[i + j];
+            if (piece_of[vert] != piece_index)
+            {
+                piece_of[vert] = piece_index;
+                local[vert] = piece.n_verts++;
+                mesh.vertex_sources.push_back(vert);
+            }
+            mesh.indices.push_back(local[vert]);
+        }
+        piece.n_indices += prim_size;
+    }
+    mesh.pieces.push_back(piece);
+    return mesh;
+}
+
+GeometryHandle GeometryArenaBase::allocate(const void* const* streams, u32 n_verts, const u32* indices, u32 n_indices)
+{
+    SplitMesh mesh = split(n_verts, indices, n_indices);
+    bool was_split = mesh.pieces.size() > 1;
+    u32 total_verts = was_split ? mesh.vertex_sources.size() : n_verts;
+
+    GeometryRange range{ 0, total_verts, 0, n_indices };
+    if (!take(free_verts, total_verts, range.base_vertex))
+    {
+        // the new space is one block with whatever was free at the end
+        grow_vertices(vertex_capacity + total_verts);
+        bool fits = take(free_verts, total_verts, range.base_vertex);
+        assert(fits && "Grown geometry arena still has no room");
+        (void)fits;
+    }
+    if (!take(free_indices, n_indices, range.first_index))
+    {
+        grow_indices(index_capacity + n_indices);
+        bool fits = take(free_indices, n_indices, range.first_index);
+        assert(fits && "Grown geometry arena still has no room");
+        (void)fits;
+    }
+    used_verts += total_verts;
+    used_indices += n_indices;
+
+    std::vector<u8> gathered;
+    for (u32 i = 0; i < n_streams_total; i++)
+    {
+        const void* data = streams[i];
+        if (was_split)
+        {
+            gathered.resize((std::size_t)total_verts * strides[i]);
+            const u8* src = (const u8*)streams[i];
+            for (u32 v = 0; v < total_verts; v++)
+            {
+                std::memcpy(&gathered[(std::size_t)v * strides[i]],
+                            src + (std::size_t)mesh.vertex_sources[v] * strides[i], strides[i]);
+            }
+            data = gathered.data();
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbos[i]);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (std::size_t)range.base_vertex * strides[i],
+                        (std::size_t)total_verts * strides[i], data);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (std::size_t)range.first_index * sizeof(Index),
+                    (std::size_t)n_indices * sizeof(Index), mesh.indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    for (auto& piece : mesh.pieces)
+    {
+        piece.base_vertex += range.base_vertex;
+        piece.first_index += range.first_index;
+    }
+
+    GeometryHandle handle;
+    if (!free_handles.empty())
+    {
+        handle.index = free_handles.back();
+        free_handles.pop_back();
+        ranges[handle.index] = range;
+        parts[handle.index] = std::move(mesh.pieces);
+        live[handle.index] = true;
+    }
+    else
+    {
+        handle.index = ranges.size();
+        ranges.push_back(range);
+        parts.push_back(std::move(mesh.pieces));
+        live.push_back(true);
+    }
+    return handle;
+}
+
+void GeometryArenaBase::free(GeometryHandle mesh)
+{
+    assert(mesh.index < ranges.size() && live[mesh.index] && "Freeing a mesh that isn't in the arena");
+    auto& range = ranges[mesh.index];
+    give_back(free_verts, Block{ range.base_vertex, range.n_verts });
+    give_back(free_indices, Block{ range.first_index, range.n_indices });
+    used_verts -= range.n_verts;
+    used_indices -= range.n_indices;
+
+    parts[mesh.index].clear();
+    live[mesh.index] = false;
+    free_handles.push_back(mesh.index);
+}
+
+void GeometryArenaBase::compact()
+{
+    SR_PROFILE_SCOPE("GeometryArena::compact");
+
+    // copying within a buffer can't overlap, so everything moves into new
+    // buffers of the same size, in the order it already has
+    std::vector<u32> by_vertex;
+    std::vector<u32> by_index;
+    for (u32 i = 0; i < ranges.size(); i++)
+    {
+        if (live[i])
+        {
+            by_vertex.push_back(i);
+            by_index.push_back(i);
+        }
+    }
+    std::sort(by_vertex.begin(), by_vertex.end(),
+              [&](u32 a, u32 b) { return ranges[a].base_vertex < ranges[b].base_vertex; });
+    std::sort(by_index.begin(), by_index.end(),
+              [&](u32 a, u32 b) { return ranges[a].first_index < ranges[b].first_index; });
+
+    // every stream moves the same way, the ranges are updated after the last
+    for (u32 s = 0; s < n_streams_total; s++)
+    {
+        GLuint new_vbo = create_buffer((std::size_t)vertex_capacity * strides[s], "GeometryArena vertices");
+        glBindBuffer(GL_COPY_READ_BUFFER, vbos[s]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_vbo);
+        u32 head = 0;
+        for (u32 i : by_vertex)
+        {
+            auto& range = ranges[i];
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                (std::size_t)range.base_vertex * strides[s], (std::size_t)head * strides[s],
+                                (std::size_t)range.n_verts * strides[s]);
+            head += range.n_verts;
+        }
+        glDeleteBuffers(1, &vbos[s]);
+        vbos[s] = new_vbo;
+    }
+    u32 head = 0;
+    for (u32 i : by_vertex)
+    {
+        for (auto& part : parts[i])
+        {
+            part.base_vertex = part.base_vertex - ranges[i].base_vertex + head;
+        }
+        ranges[i].base_vertex = head;
+        head += ranges[i].n_verts;
+    }
+
+    GLuint new_ebo = create_buffer((std::size_t)index_capacity * sizeof(Index), "GeometryArena indices");
+    glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_ebo);
+    head = 0;
+    for (u32 i : by_index)
+    {
+        auto& range = ranges[i];
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            (std::size_t)range.first_index * sizeof(Index), (std::size_t)head * sizeof(Index),
+                            (std::size_t)range.n_indices * sizeof(Index));
+        for (auto& part : parts[i])
+        {
+            part.first_index = part.first_index - range.first_index + head;
+        }
+        range.first_index = head;
+        head += range.n_indices;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &ebo);
+    ebo = new_ebo;
+    // deleting unbinds them, the cache doesn't know that
+    GLState::invalidate();
+    attach_buffers();
+
+    free_verts.clear();
+    free_indices.clear();
+    give_back(free_verts, Block{ used_verts, vertex_capacity - used_verts });
+    give_back(free_indices, Block{ used_indices, index_capacity - used_indices });
+}
+
+void GeometryArenaBase::set_label(const char* label)
+{
+    for (u32 i = 0; i < n_streams_total; i++)
+    {
+        SR_GL_LABEL(GL_VERTEX_ARRAY, vaos[i], label);
+    }
+    (void)label;
+}
+
+} // namespace sr
@@ -0,0 +1,181 @@
+#include <atomic>
+#include <cstring>
+
+#include "gldebug.h"
+
+namespace sr
+{
+
+namespace
+{
+
+static_assert((GLDebug::QUEUE_CAPACITY & (GLDebug::QUEUE_CAPACITY - 1)) == 0,
+              "Debug message queue capacity has to be a power of two");
+
+// Bounded queue for any number of producers and one consumer. Each slot's
+// sequence number says whose turn it is: equal to a producer's position when
+// it's free to write, one past it once the message is readable, and moved a
+// whole lap ahead when the consumer is done with it.
+struct Slot
+{
+    std::atomic<u64> sequence;
+    GLDebugMessage message;
+};
+
+struct GLDebugState
+{
+    Slot slots[GLDebug::QUEUE_CAPACITY];
+    std::atomic<u64> write_pos{ 0 };
+    // only the GL thread reads
+    u64 read_pos = 0;
+    std::atomic<u32> dropped{ 0 };
+
+    GLDebugState()
+    {
+        for (u32 i = 0; i < GLDebug::QUEUE_CAPACITY; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+};
+
+GLDebugState& state()
+{
+    static GLDebugState s;
+    return s;
+}
+
+void APIENTRY on_message(GLenum source, GLenum type, GLuint id, GLenum severity,
+                         GLsizei length, const GLchar* text, const void*)
+{
+    auto& s = state();
+    u64 pos = s.write_pos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true)
+    {
+        slot = &s.slots[pos & (GLDebug::QUEUE_CAPACITY - 1)];
+        u64 sequence = slot->sequence.load(std::memory_order_acquire);
+        i64 diff = (i64)sequence - (i64)pos;
+        if (diff == 0)
+        {
+            if (s.write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // full, the consumer hasn't got to this slot yet
+            s.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = s.write_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    auto& message = slot->message;
+    message.source = source;
+    message.type = type;
+    message.severity = severity;
+    message.id = id;
+    usize n = length < 0 ? std::strlen(text) : (usize)length;
+    n = n < GLDebugMessage::MAX_LENGTH - 1 ? n : GLDebugMessage::MAX_LENGTH - 1;
+    std::memcpy(message.text, text, n);
+    message.text[n] = '\0';
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+const char* type_str(GLenum type)
+{
+    switch (type)
+    {
+    case GL_DEBUG_TYPE_ERROR:               return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+    case GL_DEBUG_TYPE_MARKER:              return "marker";
+    default:                                return "other";
+    }
+}
+
+const char* severity_str(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH:   return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW:    return "low";
+    default:                       return "notification";
+    }
+}
+
+} // namespace
+
+void GLDebug::enable()
+{
+    // the queue is built before the callback can run
+    state();
+
+    glEnable(GL_DEBUG_OUTPUT);
+    // left asynchronous, so the driver doesn't have to serialize for it
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(on_message, nullptr);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+}
+
+u32 GLDebug::flush(std::ostream& os)
+{
+    auto& s = state();
+    u32 n = 0;
+    while (true)
+    {
+        Slot& slot = s.slots[s.read_pos & (QUEUE_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != s.read_pos + 1)
+        {
+            break;
+        }
+
+        auto& message = slot.message;
+        os << "GL " << type_str(message.type) << " (" << severity_str(message.severity)
+           << ", " << message.id << "): " << message.text << "\n";
+        n++;
+
+        slot.sequence.store(s.read_pos + QUEUE_CAPACITY, std::memory_order_release);
+        s.read_pos++;
+    }
+
+    u32 dropped = s.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+    {
+        os << "GL debug queue was full, " << dropped << " messages dropped\n";
+    }
+    if (n > 0 || dropped > 0)
+    {
+        os.flush();
+    }
+    return n;
+}
+
+void GLDebug::label(GLenum identifier, GLuint name, const char* label)
+{
+    if (name != 0)
+    {
+        glObjectLabel(identifier, name, -1, label);
+    }
+}
+
+void GLDebug::push_group(const char* name)
+{
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void GLDebug::pop_group()
+{
+    glPopDebugGroup();
+}
+
+} // namespace sr
@@ -0,0 +1,264 @@
+#include <cassert>
+
+#include "gpuprofiler.h"
+
+namespace sr
+{
+
+namespace
+{
+
+struct PassQueries
+{
+    const char* name;
+    u32 depth;
+    // indices into the slot's queries
+    u32 begin;
+    u32 end;
+};
+
+struct FrameSlot
+{
+    u64 frame = 0;
+    bool pending = false;
+
+    // Grown as needed and reused every time the slot comes round
+    std::vector<GLuint> queries;
+    u32 next_query = 0;
+    std::vector<PassQueries> passes;
+};
+
+// Passes a frame the storage is reserved for up front, so the first frames
+// don't have to grow it and can already run under the allocation guard
+const u32 RESERVED_PASSES = 32;
+
+struct GpuProfilerState
+{
+    GpuProfilerState()
+    {
+        for (auto& slot : slots)
+        {
+            slot.queries.reserve(2 * RESERVED_PASSES);
+            slot.passes.reserve(RESERVED_PASSES);
+        }
+        open_passes.reserve(RESERVED_PASSES);
+        latest.passes.reserve(RESERVED_PASSES);
+    }
+
+    FrameSlot slots[GpuProfiler::RING_SIZE];
+    u64 frame = 0;
+    bool in_frame = false;
+    std::vector<u32> open_passes;
+
+    GpuFrameTiming latest{};
+    u64 dropped = 0;
+
+    GpuProfiler::FrameListener listener = nullptr;
+    void* listener_user = nullptr;
+
+    // Added to GPU timestamps to get Profiler::now_ns() time
+    i64 gpu_to_cpu_ns = 0;
+    u64 calibrated_frame = 0;
+};
+
+// GPU and CPU clocks drift slowly, resync every so often
+const u64 CALIBRATE_INTERVAL = 256;
+
+GpuProfilerState& state()
+{
+    static GpuProfilerState s;
+    return s;
+}
+
+u32 timestamp(FrameSlot& slot)
+{
+    if (slot.next_query == slot.queries.size())
+    {
+        const usize grow = 32;
+        usize old_size = slot.queries.size();
+        slot.queries.resize(old_size + grow);
+        glGenQueries(grow, slot.queries.data() + old_size);
+    }
+    glQueryCounter(slot.queries[slot.next_query], GL_TIMESTAMP);
+    return slot.next_query++;
+}
+
+void calibrate(GpuProfilerState& s)
+{
+    GLint64 gpu_ns;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+    s.gpu_to_cpu_ns = (i64)Profiler::now_ns() - gpu_ns;
+    s.calibrated_frame = s.frame;
+}
+
+// Returns false without blocking if the GPU isn't done with the slot yet,
+// unless wait is set
+bool try_resolve(GpuProfilerState& s, FrameSlot& slot, bool wait)
+{
+    // timestamps complete in order, the last one being ready means all are
+    GLint available = 0;
+    if (!wait)
+    {
+        glGetQueryObjectiv(slot.queries[slot.next_query - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (!wait && !available)
+    {
+        return false;
+    }
+
+    auto read = [&](u32 query)
+    {
+        GLuint64 t;
+        glGetQueryObjectui64v(slot.queries[query], GL_QUERY_RESULT, &t);
+        return (u64)((i64)t + s.gpu_to_cpu_ns);
+    };
+
+    // the frame is bracketed by the first and last query
+    u64 frame_begin = read(0);
+    u64 frame_end = read(slot.next_query - 1);
+    s.latest.frame = slot.frame;
+    s.latest.frame_ms = (frame_end - frame_begin) / 1e6;
+    s.latest.passes.clear();
+    Profiler::record_gpu("GPU frame", frame_begin, frame_end);
+
+    for (auto& pass : slot.passes)
+    {
+        u64 begin = read(pass.begin);
+        u64 end = read(pass.end);
+        s.latest.passes.push_back(GpuPassTiming{ pass.name, pass.depth, (end - begin) / 1e6 });
+        Profiler::record_gpu(pass.name, begin, end);
+    }
+
+    slot.pending = false;
+    if (s.listener)
+    {
+        s.listener(s.latest, s.listener_user);
+    }
+    return true;
+}
+
+void resolve_pending(GpuProfilerState& s, bool wait)
+{
+    // Oldest first, once one isn't ready the newer ones won't be either.
+    // The oldest is in the slot the next frame takes over.
+    for (u64 age = GpuProfiler::RING_SIZE; age > 0; age--)
+    {
+        if (s.frame < age)
+        {
+            continue;
+        }
+        auto& slot = s.slots[(s.frame - age) % GpuProfiler::RING_SIZE];
+        if (slot.pending && !try_resolve(s, slot, wait))
+        {
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void GpuProfiler::begin_frame()
+{
+    auto& s = state();
+    assert(!s.in_frame && "GpuProfiler::begin_frame called twice");
+
+    resolve_pending(s, false);
+
+    if (s.frame == 0 || s.frame - s.calibrated_frame >= CALIBRATE_INTERVAL)
+    {
+        calibrate(s);
+    }
+
+    auto& slot = s.slots[s.frame % RING_SIZE];
+    if (slot.pending)
+    {
+        s.dropped++;
+    }
+    slot.frame = s.frame + 1;
+    slot.pending = false;
+    slot.next_query = 0;
+    slot.passes.clear();
+    s.open_passes.clear();
+    s.in_frame = true;
+
+    timestamp(slot);
+}
+
+void GpuProfiler::end_frame()
+{
+    auto& s = state();
+    if (!s.in_frame)
+    {
+        return;
+    }
+    assert(s.open_passes.empty() && "GPU pass still open at end of frame");
+
+    auto& slot = s.slots[s.frame % RING_SIZE];
+    timestamp(slot);
+    slot.pending = true;
+    s.in_frame = false;
+    s.frame++;
+}
+
+void GpuProfiler::begin_pass(const char* name)
+{
+    auto& s = state();
+    // passes outside a frame, e.g. during loading, aren't timed
+    if (!s.in_frame)
+    {
+        return;
+    }
+
+    auto& slot = s.slots[s.frame % RING_SIZE];
+    PassQueries pass;
+    pass.name = name;
+    pass.depth = s.open_passes.size();
+    pass.begin = timestamp(slot);
+    pass.end = pass.begin;
+    s.open_passes.push_back(slot.passes.size());
+    slot.passes.push_back(pass);
+}
+
+void GpuProfiler::end_pass()
+{
+    auto& s = state();
+    if (!s.in_frame || s.open_passes.empty())
+    {
+        return;
+    }
+
+    auto& slot = s.slots[s.frame % RING_SIZE];
+    slot.passes[s.open_passes.back()].end = timestamp(slot);
+    s.open_passes.pop_back();
+}
+
+const GpuFrameTiming& GpuProfiler::latest()
+{
+    return state().latest;
+}
+
+u64 GpuProfiler::dropped_frames()
+{
+    return state().dropped;
+}
+
+u64 GpuProfiler::last_frame()
+{
+    return state().frame;
+}
+
+void GpuProfiler::flush()
+{
+    auto& s = state();
+    assert(!s.in_frame && "GpuProfiler::flush called inside a frame");
+    resolve_pending(s, true);
+}
+
+void GpuProfiler::set_listener(FrameListener listener, void* user)
+{
+    auto& s = state();
+    s.listener = listener;
+    s.listener_user = user;
+}
+
+} // namespace sr
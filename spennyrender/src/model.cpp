@@ -4,8 +4,12 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/GltfMaterial.h>
+#include <cstring>
 #include <stb_image.h>
 
+#include "alloctrack.h"
+#include "profiler.h"
 #include "spennytypes.h"
 #include "texture.h"
 
@@ -88,6 +92,7 @@ Texture load_embedded_texture(const aiScene* scene, const aiString* tex_name, bo
         u32 format = is_linear ? GL_RGBA : GL_SRGB_ALPHA;
         Texture result;
         result.load_texture(w, h, data, format, GL_REPEAT);
+        result.set_label(name_cstr);
         return result;
     }
     else
@@ -98,7 +103,7 @@ Texture load_embedded_texture(const aiScene* scene, const aiString* tex_name, bo
     return Texture{};
 }
 
-void load_materials(const aiScene* scene, Model* model)
+void load_materials(const aiScene* scene, Model* model, bool load_textures)
 {
     model->materials.resize(scene->mNumMaterials);
     for (u32 mat_idx = 0; mat_idx < scene->mNumMaterials; mat_idx++)
@@ -109,6 +114,19 @@ void load_materials(const aiScene* scene, Model* model)
         ai_material->Get(AI_MATKEY_METALLIC_FACTOR, material.metallic);
         ai_material->Get(AI_MATKEY_ROUGHNESS_FACTOR, material.roughness);
 
+        aiString alpha_mode;
+        if (ai_material->Get(AI_MATKEY_GLTF_ALPHAMODE, alpha_mode) == AI_SUCCESS
+            && !strcmp(alpha_mode.C_Str(), "MASK"))
+        {
+            material.alpha_test = true;
+            ai_material->Get(AI_MATKEY_GLTF_ALPHACUTOFF, material.alpha_cutoff);
+        }
+
+        if (!load_textures)
+        {
+            continue;
+        }
+
         if (ai_material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
         {
             aiString diffuse_file;
@@ -132,8 +150,10 @@ void load_materials(const aiScene* scene, Model* model)
     }
 }
 
-std::optional<Model> ModelLoader::load_from_file(const std::string& filename)
+std::optional<Model> ModelLoader::load_from_file(const std::string& filename, u32 flags)
 {
+    SR_PROFILE_SCOPE("ModelLoader::load_from_file");
+    SR_ALLOC_TAG("models");
     Assimp::Importer importer;
 
     const auto scene = importer.ReadFile(filename,
@@ -175,7 +195,7 @@ std::optional<Model> ModelLoader::load_from_file(const std::string& filename)
         }
     }
 
-    load_materials(scene, &result);
+    load_materials(scene, &result, !(flags & ModelLoadFlags_NoTextures));
 
     return result;
 }
@@ -0,0 +1,309 @@
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "framestats.h"
+#include "gldebug.h"
+#include "glstate.h"
+#include "pipeline.h"
+#include "profiler.h"
+
+namespace sr
+{
+
+namespace
+{
+
+const u64 HASH_SEED = 0xcbf29ce484222325ull;
+const u64 PRIME = 0x100000001b3ull;
+
+u64 hash_u64(u64 hash, u64 value)
+{
+    return (hash ^ value) * PRIME;
+}
+
+u64 target_hash(const RenderTargetFormat& target)
+{
+    u64 hash = HASH_SEED;
+    hash = hash_u64(hash, target.n_color);
+    for (u32 i = 0; i < target.n_color; i++)
+    {
+        hash = hash_u64(hash, target.color[i]);
+    }
+    hash = hash_u64(hash, target.depth);
+    return hash_u64(hash, target.samples);
+}
+
+// side of the prewarm targets
+constexpr i32 PREWARM_SIZE = 4;
+// bound to every uniform and storage binding while prewarming, the minimum
+// GL_MAX_UNIFORM_BLOCK_SIZE
+constexpr std::size_t PREWARM_BUFFER_BYTES = 16384;
+
+struct PipelineCacheState
+{
+    // different descs can share a hash, they chain under it
+    std::unordered_multimap<u64, std::unique_ptr<Pipeline>> pipelines;
+    // made since the last prewarm()
+    std::vector<const Pipeline*> pending;
+    std::vector<LatePipeline> late;
+    bool in_frame = false;
+
+    std::unordered_map<u64, GLuint> vertex_layouts;
+    // prewarm framebuffers by target_hash
+    std::unordered_map<u64, GLuint> targets;
+    GLuint zero_buffer = 0;
+};
+
+PipelineCacheState& state()
+{
+    static PipelineCacheState s;
+    return s;
+}
+
+GLuint prewarm_target(const RenderTargetFormat& format)
+{
+    auto& s = state();
+    u64 key = target_hash(format);
+    auto it = s.targets.find(key);
+    if (it != s.targets.end())
+    {
+        return it->second;
+    }
+
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, fbo);
+
+    // renderbuffers take any renderable format without a matching
+    // format and type
+    auto attach = [&](GLenum attachment, GLenum internal_format) {
+        GLuint rbo;
+        glGenRenderbuffers(1, &rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, format.samples, internal_format, PREWARM_SIZE, PREWARM_SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, rbo);
+    };
+
+    GLenum draw_buffers[RenderTargetFormat::MAX_COLOR_ATTACHMENTS];
+    for (u32 i = 0; i < format.n_color; i++)
+    {
+        attach(GL_COLOR_ATTACHMENT0 + i, format.color[i]);
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    if (format.n_color > 0)
+    {
+        glDrawBuffers(format.n_color, draw_buffers);
+    }
+    else
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    if (format.depth != 0)
+    {
+        attach(GL_DEPTH_ATTACHMENT, format.depth);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    SR_GL_LABEL(GL_FRAMEBUFFER, fbo, "prewarm target");
+#ifdef SPENNY_RENDER_DEBUG
+    auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Prewarm framebuffer was NOT complete, it was " << status << std::endl;
+    }
+#endif
+
+    s.targets[key] = fbo;
+    return fbo;
+}
+
+// Shaders read uniform blocks and storage buffers in their prologue, so
+// they get something zeroed to read instead of whatever's bound
+void bind_zero_buffers()
+{
+    auto& s = state();
+    if (s.zero_buffer == 0)
+    {
+        std::vector<u8> zeros(PREWARM_BUFFER_BYTES, 0);
+        glGenBuffers(1, &s.zero_buffer);
+        GLState::bind_buffer(GL_UNIFORM_BUFFER, s.zero_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, zeros.size(), zeros.data(), GL_STATIC_DRAW);
+        SR_GL_LABEL(GL_BUFFER, s.zero_buffer, "prewarm zeros");
+    }
+    for (u32 i = 0; i < GLState::MAX_UNIFORM_BUFFER_BINDINGS; i++)
+    {
+        GLState::bind_buffer_base(GL_UNIFORM_BUFFER, i, s.zero_buffer);
+    }
+    for (u32 i = 0; i < GLState::MAX_SHADER_STORAGE_BUFFER_BINDINGS; i++)
+    {
+        GLState::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, i, s.zero_buffer);
+    }
+}
+
+} // namespace
+
+u64 PipelineDesc::hash() const
+{
+    u64 hash = HASH_SEED;
+    hash = hash_u64(hash, program);
+    hash = hash_u64(hash, vertex_layout);
+    hash = hash_u64(hash, target_hash(target));
+    hash = hash_u64(hash, depth.test);
+    hash = hash_u64(hash, depth.write);
+    hash = hash_u64(hash, depth.func);
+    hash = hash_u64(hash, blend);
+    return hash_u64(hash, cull);
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const
+{
+    if (target.n_color != other.target.n_color)
+    {
+        return false;
+    }
+    for (u32 i = 0; i < target.n_color; i++)
+    {
+        if (target.color[i] != other.target.color[i])
+        {
+            return false;
+        }
+    }
+    return program == other.program
+        && vertex_layout == other.vertex_layout
+        && target.depth == other.target.depth
+        && target.samples == other.target.samples
+        && depth.test == other.depth.test
+        && depth.write == other.depth.write
+        && depth.func == other.depth.func
+        && blend == other.blend
+        && cull == other.cull;
+}
+
+Pipeline::Pipeline(const PipelineDesc& desc, u64 hash)
+    : desc(desc)
+      , hash(hash)
+{
+}
+
+void Pipeline::bind() const
+{
+    GLState::use_program(desc.program);
+
+    GLState::enable(GL_DEPTH_TEST, desc.depth.test);
+    GLState::depth_mask(desc.depth.write);
+    GLState::depth_func(desc.depth.func);
+
+    GLState::enable(GL_BLEND, desc.blend != BlendMode_Opaque);
+    switch (desc.blend)
+    {
+    case BlendMode_Opaque: break;
+    case BlendMode_Alpha: GLState::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); break;
+    case BlendMode_Additive: GLState::blend_func(GL_ONE, GL_ONE); break;
+    }
+
+    GLState::enable(GL_CULL_FACE, desc.cull != CullMode_None);
+    switch (desc.cull)
+    {
+    case CullMode_None: break;
+    case CullMode_Back: GLState::cull_face(GL_BACK); break;
+    case CullMode_Front: GLState::cull_face(GL_FRONT); break;
+    }
+}
+
+const Pipeline& PipelineCache::get(const PipelineDesc& desc)
+{
+    auto& s = state();
+    u64 hash = desc.hash();
+    auto range = s.pipelines.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++)
+    {
+        if (it->second->desc == desc)
+        {
+            return *it->second;
+        }
+    }
+
+    SR_PROFILE_SCOPE("PipelineCache::create");
+    auto* pipeline = new Pipeline(desc, hash);
+    s.pipelines.emplace(hash, std::unique_ptr<Pipeline>(pipeline));
+    s.pending.push_back(pipeline);
+
+    if (s.in_frame)
+    {
+        u64 frame = FrameStatsCounter::current().frame;
+        s.late.push_back(LatePipeline{ frame, hash, desc });
+        FrameStatsCounter::current().late_pipelines++;
+    }
+    return *pipeline;
+}
+
+void PipelineCache::prewarm()
+{
+    SR_PROFILE_SCOPE("PipelineCache::prewarm");
+    auto& s = state();
+    if (s.pending.empty())
+    {
+        return;
+    }
+    SR_GL_DEBUG_GROUP("PipelineCache::prewarm");
+
+    bind_zero_buffers();
+    GLState::viewport(0, 0, PREWARM_SIZE, PREWARM_SIZE);
+
+    for (auto* pipeline : s.pending)
+    {
+        auto& desc = pipeline->desc;
+        auto layout = s.vertex_layouts.find(desc.vertex_layout);
+        if (layout == s.vertex_layouts.end())
+        {
+            std::cout << "No vertex layout registered for pipeline " << std::hex << pipeline->hash
+                      << std::dec << ", not prewarming it" << std::endl;
+            continue;
+        }
+
+        GLState::bind_framebuffer(GL_FRAMEBUFFER, prewarm_target(desc.target));
+        pipeline->bind();
+        GLState::bind_vertex_array(layout->second);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    s.pending.clear();
+
+    // the draws only count once the driver has actually run them
+    glFinish();
+    GLState::bind_framebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PipelineCache::begin_frame()
+{
+    state().in_frame = true;
+}
+
+void PipelineCache::end_frame()
+{
+    state().in_frame = false;
+}
+
+u32 PipelineCache::n_pipelines()
+{
+    return state().pipelines.size();
+}
+
+const std::vector<LatePipeline>& PipelineCache::late_pipelines()
+{
+    return state().late;
+}
+
+bool PipelineCache::has_vertex_layout(u64 key)
+{
+    return state().vertex_layouts.count(key) != 0;
+}
+
+void PipelineCache::add_vertex_layout(u64 key, GLuint vao)
+{
+    state().vertex_layouts[key] = vao;
+}
+
+} // namespace sr
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+namespace sr
+{
+
+namespace
+{
+
+// Written by a single thread, its own or the GL thread for the GPU track.
+// writing is set around each event, so a dump can wait for the writer to
+// get out of the ring before reading it.
+struct ThreadBuffer
+{
+    u32 thread_id;
+    const char* track_name;
+    std::atomic<u64> write_pos{0};
+    std::atomic<bool> writing{false};
+    ProfileEvent events[Profiler::THREAD_CAPACITY];
+};
+
+struct ProfilerState
+{
+    // The GPU track is written from inside frames, where allocating is off
+    // limits, so its buffer is made along with everything else
+    ProfilerState()
+    {
+        gpu_buffer = new ThreadBuffer;
+        gpu_buffer->track_name = "GPU";
+        gpu_buffer->thread_id = 0;
+        buffers.push_back(std::unique_ptr<ThreadBuffer>(gpu_buffer));
+    }
+
+    // Taken when a thread starts or stops recording and when dumping
+    std::mutex buffers_lock;
+    // Freed at exit. Buffers of threads that have finished still dump until
+    // a new thread takes them over, so there are never more than the most
+    // threads that recorded at once.
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<ThreadBuffer*> unused_buffers;
+    ThreadBuffer* gpu_buffer;
+    // Writers drop their events while it's set
+    std::atomic<bool> dumping{false};
+
+    std::atomic<u64> frame_pos{0};
+    u64 frame_starts[Profiler::FRAME_CAPACITY];
+};
+
+ProfilerState& state()
+{
+    static ProfilerState s;
+    return s;
+}
+
+ThreadBuffer* new_buffer()
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.buffers_lock);
+    if (!s.unused_buffers.empty())
+    {
+        // the track carries on with the new thread, minus the old events
+        auto* buffer = s.unused_buffers.back();
+        s.unused_buffers.pop_back();
+        buffer->write_pos.store(0, std::memory_order_relaxed);
+        return buffer;
+    }
+    auto* buffer = new ThreadBuffer;
+    buffer->track_name = nullptr;
+    buffer->thread_id = s.buffers.size();
+    s.buffers.push_back(std::unique_ptr<ThreadBuffer>(buffer));
+    return buffer;
+}
+
+// Hands the thread's buffer on when the thread exits
+struct ThreadBufferOwner
+{
+    ThreadBuffer* buffer = nullptr;
+
+    ~ThreadBufferOwner()
+    {
+        if (buffer)
+        {
+            auto& s = state();
+            std::lock_guard<std::mutex> lock(s.buffers_lock);
+            s.unused_buffers.push_back(buffer);
+        }
+    }
+};
+
+ThreadBuffer* thread_buffer()
+{
+    thread_local ThreadBufferOwner owner;
+    if (!owner.buffer)
+    {
+        owner.buffer = new_buffer();
+    }
+    return owner.buffer;
+}
+
+void push_event(ThreadBuffer* buffer, const ProfileEvent& event)
+{
+    // Both sides set their flag then check the other's, all seq_cst, so
+    // either the dump sees writing and waits or this sees dumping and drops
+    // the event
+    buffer->writing.store(true, std::memory_order_seq_cst);
+    if (!state().dumping.load(std::memory_order_seq_cst))
+    {
+        u64 pos = buffer->write_pos.load(std::memory_order_relaxed);
+        buffer->events[pos % Profiler::THREAD_CAPACITY] = event;
+        buffer->write_pos.store(pos + 1, std::memory_order_release);
+    }
+    buffer->writing.store(false, std::memory_order_release);
+}
+
+void write_escaped(std::ostream& os, const char* str)
+{
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            os << '\\';
+        }
+        os << *str;
+    }
+}
+
+} // namespace
+
+u64 Profiler::now_ns()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+void Profiler::record(const char* name, u64 start_ns, u64 end_ns)
+{
+    push_event(thread_buffer(), ProfileEvent{ name, start_ns, end_ns });
+}
+
+void Profiler::record_gpu(const char* name, u64 start_ns, u64 end_ns)
+{
+    push_event(state().gpu_buffer, ProfileEvent{ name, start_ns, end_ns });
+}
+
+void Profiler::mark_frame()
+{
+    auto& s = state();
+    u64 pos = s.frame_pos.load(std::memory_order_relaxed);
+    s.frame_starts[pos % FRAME_CAPACITY] = now_ns();
+    s.frame_pos.store(pos + 1, std::memory_order_release);
+}
+
+void Profiler::write_chrome_trace(std::ostream& os, u32 n_frames)
+{
+    auto& s = state();
+
+    // Start of the oldest frame we want, everything if there are no marks
+    u64 window_start = 0;
+    u64 frame_pos = s.frame_pos.load(std::memory_order_acquire);
+    n_frames = std::min<u64>({ n_frames, frame_pos, FRAME_CAPACITY });
+    if (n_frames > 0)
+    {
+        window_start = s.frame_starts[(frame_pos - n_frames) % FRAME_CAPACITY];
+    }
+
+    std::vector<std::pair<u32, ProfileEvent>> events;
+    std::vector<std::pair<u32, const char*>> tracks;
+    {
+        std::lock_guard<std::mutex> lock(s.buffers_lock);
+        s.dumping.store(true, std::memory_order_seq_cst);
+        for (auto& buffer : s.buffers)
+        {
+            // an event already on its way in finishes first, nothing else
+            // touches the ring until dumping is cleared
+            while (buffer->writing.load(std::memory_order_seq_cst))
+            {
+                std::this_thread::yield();
+            }
+
+            tracks.push_back({ buffer->thread_id, buffer->track_name });
+            u64 end = buffer->write_pos.load(std::memory_order_acquire);
+            u64 begin = end > THREAD_CAPACITY ? end - THREAD_CAPACITY : 0;
+            for (u64 i = begin; i < end; i++)
+            {
+                const auto& event = buffer->events[i % THREAD_CAPACITY];
+                if (event.start_ns >= window_start)
+                {
+                    events.push_back({ buffer->thread_id, event });
+                }
+            }
+        }
+        s.dumping.store(false, std::memory_order_release);
+    }
+
+    // Parents before children when they start on the same tick
+    std::sort(events.begin(), events.end(), [](const auto& a, const auto& b)
+    {
+        if (a.second.start_ns != b.second.start_ns)
+        {
+            return a.second.start_ns < b.second.start_ns;
+        }
+        return a.second.end_ns > b.second.end_ns;
+    });
+
+    // Chrome wants microseconds, keep the nanoseconds as decimals
+    auto write_us = [&](u64 ns)
+    {
+        os << ns / 1000 << '.' << (char)('0' + ns / 100 % 10) << (char)('0' + ns / 10 % 10) << (char)('0' + ns % 10);
+    };
+
+    os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    for (auto& [tid, track_name] : tracks)
+    {
+        os << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << tid
+           << ", \"args\": {\"name\": \"";
+        if (track_name)
+        {
+            write_escaped(os, track_name);
+        }
+        else
+        {
+            os << "CPU " << tid;
+        }
+        os << "\"}}";
+        first = false;
+    }
+    for (auto& [tid, event] : events)
+    {
+        os << (first ? "\n" : ",\n") << "{\"name\": \"";
+        write_escaped(os, event.name);
+        os << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << tid << ", \"ts\": ";
+        write_us(event.start_ns - window_start);
+        os << ", \"dur\": ";
+        write_us(event.end_ns - event.start_ns);
+        os << "}";
+        first = false;
+    }
+
+    // Frame boundaries as instant events
+    for (u64 i = frame_pos - n_frames; i < frame_pos; i++)
+    {
+        os << (first ? "\n" : ",\n") << "{\"name\": \"frame\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": 0, \"ts\": ";
+        write_us(s.frame_starts[i % FRAME_CAPACITY] - window_start);
+        os << "}";
+        first = false;
+    }
+    os << "\n]}" << std::endl;
+}
+
+bool Profiler::write_chrome_trace(const std::string& path, u32 n_frames)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cout << "Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+    write_chrome_trace(out, n_frames);
+    return true;
+}
+
+} // namespace sr
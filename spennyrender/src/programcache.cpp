@@ -0,0 +1,216 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "programcache.h"
+
+namespace sr
+{
+
+namespace
+{
+
+const char MAGIC[4] = { 'S', 'R', 'P', 'B' };
+const u32 FORMAT_VERSION = 1;
+
+struct CacheFileHeader
+{
+    char magic[4];
+    u32 version;
+    u64 key;
+    u64 compile_ns;
+    u32 binary_format;
+    u32 length;
+};
+
+struct ProgramCacheState
+{
+    bool enabled = false;
+    std::filesystem::path dir;
+    // hash of GL_RENDERER and GL_VERSION, folded into every key
+    u64 context_hash = 0;
+    ProgramCacheStats stats{};
+};
+
+ProgramCacheState& state()
+{
+    static ProgramCacheState s;
+    return s;
+}
+
+// FNV-1a with a zero byte after each string, so "ab" + "c" != "a" + "bc"
+u64 hash_str(u64 hash, const char* str, usize len)
+{
+    const u64 PRIME = 0x100000001b3ull;
+    for (usize i = 0; i < len; i++)
+    {
+        hash = (hash ^ (u8)str[i]) * PRIME;
+    }
+    return hash * PRIME;
+}
+
+const u64 HASH_SEED = 0xcbf29ce484222325ull;
+
+std::filesystem::path entry_path(u64 key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return state().dir / name;
+}
+
+u64 now_ns()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+} // namespace
+
+bool ProgramCache::enable(const std::string& dir)
+{
+    auto& s = state();
+
+    GLint n_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+    if (n_formats == 0)
+    {
+        std::cout << "Program binary cache: driver has no program binary formats, cache off" << std::endl;
+        return false;
+    }
+
+    std::error_code err;
+    std::filesystem::create_directories(dir, err);
+    if (err)
+    {
+        std::cout << "Program binary cache: can't create " << dir << ": " << err.message() << std::endl;
+        return false;
+    }
+
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    s.context_hash = hash_str(HASH_SEED, renderer, std::strlen(renderer));
+    s.context_hash = hash_str(s.context_hash, version, std::strlen(version));
+    s.dir = dir;
+    s.enabled = true;
+    return true;
+}
+
+bool ProgramCache::enabled()
+{
+    return state().enabled;
+}
+
+u64 ProgramCache::program_key(const std::string& vs_src, const std::string& fs_src, const std::string& defines)
+{
+    u64 hash = state().context_hash;
+    hash = hash_str(hash, vs_src.data(), vs_src.size());
+    hash = hash_str(hash, fs_src.data(), fs_src.size());
+    hash = hash_str(hash, defines.data(), defines.size());
+    return hash;
+}
+
+GLuint ProgramCache::load(u64 key)
+{
+    auto& s = state();
+    if (!s.enabled)
+    {
+        return 0;
+    }
+
+    u64 start = now_ns();
+    std::ifstream in(entry_path(key), std::ios::binary);
+    CacheFileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, MAGIC, sizeof(MAGIC))
+        || header.version != FORMAT_VERSION
+        || header.key != key)
+    {
+        s.stats.misses++;
+        return 0;
+    }
+
+    std::vector<char> binary(header.length);
+    if (!in.read(binary.data(), binary.size()))
+    {
+        s.stats.misses++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binary_format, binary.data(), binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        // the driver changed its mind about the binary, it'll be rebuilt
+        glDeleteProgram(program);
+        s.stats.misses++;
+        return 0;
+    }
+
+    f64 load_ms = (now_ns() - start) / 1e6;
+    s.stats.hits++;
+    s.stats.load_ms += load_ms;
+    s.stats.saved_ms += header.compile_ns / 1e6 - load_ms;
+    return program;
+}
+
+void ProgramCache::store(u64 key, GLuint program, u64 compile_ns)
+{
+    auto& s = state();
+    if (!s.enabled)
+    {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    CacheFileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.key = key;
+    header.compile_ns = compile_ns;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.binary_format = format;
+    header.length = length;
+
+    // write then rename so a crash never leaves half an entry behind
+    auto path = entry_path(key);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), binary.size());
+        if (!out)
+        {
+            std::cout << "Program binary cache: failed to write " << tmp_path << std::endl;
+            return;
+        }
+    }
+    std::error_code err;
+    std::filesystem::rename(tmp_path, path, err);
+    if (!err)
+    {
+        s.stats.stores++;
+    }
+}
+
+const ProgramCacheStats& ProgramCache::stats()
+{
+    return state().stats;
+}
+
+} // namespace sr
@@ -1,17 +1,41 @@
 #include <SDL3/SDL.h>
 #include <glad/glad.h>
 #include <memory>
+#include "alloctrack.h"
+#include "drawdata.h"
+#include "gldebug.h"
+#include "glstate.h"
+#include "gpuprofiler.h"
+#include "pipeline.h"
+#include "profiler.h"
 #include "renderer.h"
+#include "shader.h"
+#include "vertpack.h"
 
 namespace sr
 {
 
 std::unique_ptr<Renderer> Renderer::renderer = nullptr;
 
-Renderer::SDL::SDL(const std::string& win_title, u32 w, u32 h)
+namespace
+{
+
+// grows if a frame needs more
+constexpr std::size_t UPLOAD_RING_BYTES_PER_FRAME = 1 << 20;
+
+} // namespace
+
+Renderer::SDL::SDL(const std::string& win_title, u32 w, u32 h, u32 flags)
     : window(nullptr), renderer(nullptr), gl_context(nullptr)
 {
     int gl_status = -1;
+    SDL_WindowFlags window_flags = SDL_WINDOW_OPENGL;
+
+    if (flags & RendererFlags_Headless)
+    {
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+        window_flags |= SDL_WINDOW_HIDDEN;
+    }
 
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -19,10 +43,13 @@ Renderer::SDL::SDL(const std::string& win_title, u32 w, u32 h)
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+#ifdef SPENNY_RENDER_DEBUG
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
 
-    window = SDL_CreateWindow(win_title.c_str(), w, h, SDL_WINDOW_OPENGL);
+    window = SDL_CreateWindow(win_title.c_str(), w, h, window_flags);
     if (!window)
     {
         goto WindowErr;
@@ -40,7 +67,8 @@ Renderer::SDL::SDL(const std::string& win_title, u32 w, u32 h)
         goto SDLErr;
     }
 
-    gl_status = gladLoadGL();
+    // go through SDL so this also works for EGL contexts
+    gl_status = gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
     if (!gl_status)
     {
         goto GLErr;
@@ -48,10 +76,48 @@ Renderer::SDL::SDL(const std::string& win_title, u32 w, u32 h)
     std::cout << "Loaded GL version "
               << GLVersion.major << "." << GLVersion.minor << std::endl;
 
+    // SSBOs, base instance draws, multi-draw indirect, vertex attrib binding
+    // and KHR_debug are all core in 4.3. Draws index DrawData's arrays by
+    // gl_BaseInstanceARB, which needs GL_ARB_shader_draw_parameters.
+    if (!GLAD_GL_VERSION_4_3)
+    {
+        std::cerr << "GL 4.3 is required, the context is "
+                  << GLVersion.major << "." << GLVersion.minor << std::endl;
+        goto GLErr;
+    }
+    if (!GLAD_GL_ARB_shader_draw_parameters)
+    {
+        std::cerr << "GL_ARB_shader_draw_parameters is required" << std::endl;
+        goto GLErr;
+    }
+    // the upload ring is a persistently mapped buffer
+    if (!GLAD_GL_ARB_buffer_storage)
+    {
+        std::cerr << "GL_ARB_buffer_storage is required" << std::endl;
+        goto GLErr;
+    }
+    SR_GL_DEBUG_ENABLE();
+
+    // let the driver pick how many threads compile shaders in the background
+    if (GLAD_GL_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+    else if (GLAD_GL_ARB_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+
+    if (flags & RendererFlags_NoVsync)
+    {
+        SDL_GL_SetSwapInterval(0);
+    }
+
     return;
 
 GLErr:
     std::cerr << "Failed to load GL" << std::endl;
+    SDL_GL_DestroyContext(gl_context);
 SDLErr:
     SDL_DestroyWindow(window);
 WindowErr:
@@ -79,18 +145,22 @@ Renderer::SDL::~SDL()
     }
 }
 
-Renderer::Renderer(const std::string& win_title, u32 w, u32 h)
-    : sdl(win_title, w, h)
+Renderer::Renderer(const std::string& win_title, u32 w, u32 h, u32 flags)
+    : sdl(win_title, w, h, flags)
       , default_framebuffer(nullptr)
       , camera_pos{2, 1, 2}
       , camera_target{0, 0.5, 0}
       , fovy{45.0}
       , near_clip{0.1}
       , far_clip{100.0}
-      , global_ubo{0}
+      , upload_ring(nullptr)
       , global_uniforms{0}
 {
-    assert(sdl.window && "SDL initialization failed");
+    if (!sdl.window)
+    {
+        // start() sees this and gives up
+        return;
+    }
 
     i32 out_w, out_h;
     SDL_GetRenderOutputSize(sdl.renderer, &out_w, &out_h);
@@ -100,9 +170,14 @@ Renderer::Renderer(const std::string& win_title, u32 w, u32 h)
     default_framebuffer->width = out_w;
     default_framebuffer->height = out_h;
     default_framebuffer->m_fbo = 0;
+    // what SDL was asked for above
+    default_framebuffer->format = RenderTargetFormat{ { GL_RGBA8 }, 1, GL_DEPTH_COMPONENT24, 4 };
+
+    // a new context, nothing cached from a previous one applies
+    GLState::invalidate();
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
+    GLState::enable(GL_DEPTH_TEST, true);
+    GLState::depth_func(GL_LEQUAL);
     glEnable(GL_MULTISAMPLE);
 
     global_uniforms.clip.x = out_w;
@@ -114,17 +189,23 @@ Renderer::Renderer(const std::string& win_title, u32 w, u32 h)
     auto aspect = out_w / out_h;
     global_uniforms.perspective = sm::perspective(fovy, aspect, near_clip, far_clip);
 
-    glGenBuffers(1, &global_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, global_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(GlobalUniforms), &global_uniforms, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, global_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    upload_ring = std::unique_ptr<UploadRing>(new UploadRing(UPLOAD_RING_BYTES_PER_FRAME));
+
+    Shader::add_shared_source("global_uniforms", GLOBAL_UNIFORMS_GLSL);
+    Shader::add_shared_source("draw_data", DRAW_DATA_GLSL);
+    Shader::add_shared_source("packed_vertex", PACKED_VERTEX_GLSL);
 }
 
-void Renderer::start(const std::string& win_title, u32 w, u32 h)
+bool Renderer::start(const std::string& win_title, u32 w, u32 h, u32 flags)
 {
     assert(renderer == nullptr && "Cannot double-start renderer");
-    renderer = std::unique_ptr<Renderer>(new Renderer(win_title, w, h));
+    renderer = std::unique_ptr<Renderer>(new Renderer(win_title, w, h, flags));
+    if (!renderer->sdl.window)
+    {
+        renderer.reset(nullptr);
+        return false;
+    }
+    return true;
 }
 
 void Renderer::end()
@@ -137,14 +218,50 @@ void Renderer::end()
 
 void Renderer::begin_frame()
 {
+    AllocTracker::begin_frame();
+    SR_PROFILE_FRAME();
+    SR_PROFILE_SCOPE("Renderer::begin_frame");
+    SR_GPU_PROFILE_BEGIN_FRAME();
+    PipelineCache::begin_frame();
     auto& framebuf = get_default_framebuffer();
     framebuf->clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // waits if the CPU is a full ring of frames ahead of the GPU
+    get_renderer()->upload_ring->begin_frame();
     get_renderer()->send_global_uniforms();
 }
 
 void Renderer::end_frame()
 {
+    SR_PROFILE_SCOPE("Renderer::end_frame");
+    SR_GPU_PROFILE_END_FRAME();
+    get_renderer()->upload_ring->end_frame();
+    PipelineCache::end_frame();
+    SR_GL_DEBUG_FLUSH();
+
+    // the swap belongs to the window system, leave it out of the guard
+    AllocTracker::end_frame();
+    auto allocs = AllocTracker::last_frame();
+    FrameStatsCounter::current().heap_allocs = allocs.allocs;
+    FrameStatsCounter::current().heap_bytes = allocs.bytes;
+
     SDL_GL_SwapWindow(get_renderer()->sdl.window);
+    FrameStatsCounter::end_frame();
+}
+
+const FrameStats& Renderer::get_frame_stats()
+{
+    return FrameStatsCounter::get_history(0);
+}
+
+const FrameStats& Renderer::get_frame_stats_history(u32 frames_ago)
+{
+    assert(frames_ago < FrameStatsCounter::history_size() && "Frame is no longer in the stats history");
+    return FrameStatsCounter::get_history(frames_ago);
+}
+
+u32 Renderer::get_frame_stats_history_size()
+{
+    return FrameStatsCounter::history_size();
 }
 
 std::unique_ptr<Renderer>& Renderer::get_renderer()
@@ -158,6 +275,28 @@ std::unique_ptr<Framebuffer>& Renderer::get_default_framebuffer()
     return get_renderer()->default_framebuffer;
 }
 
+void Renderer::multi_draw_indexed_geom(const GeometryArenaBase& arena, IndirectDrawList& draws, u32 n_streams)
+{
+    if (draws.empty())
+    {
+        return;
+    }
+    auto alloc = get_upload_ring().upload(draws.data(), draws.size() * sizeof(DrawElementsIndirectCommand),
+                                          alignof(DrawElementsIndirectCommand));
+    arena.bind(n_streams);
+    GLState::bind_buffer(GL_DRAW_INDIRECT_BUFFER, alloc.buffer);
+
+    FrameStatsCounter::count_draw(arena.get_prim_type(), draws.get_n_indices());
+    FrameStatsCounter::current().indirect_draws += draws.size();
+    glMultiDrawElementsIndirect(arena.get_prim_type(), GeometryArenaBase::INDEX_TYPE, (void*)alloc.offset, draws.size(), 0);
+    draws.clear();
+}
+
+UploadRing& Renderer::get_upload_ring()
+{
+    return *get_renderer()->upload_ring;
+}
+
 void Renderer::set_clear_color(sm::Vec4 rgba)
 {
     glClearColor(rgba.r, rgba.g, rgba.b, rgba.a);
@@ -193,11 +332,6 @@ const Renderer::SDL& Renderer::get_sdl()
     return sdl;
 }
 
-void Renderer::use_material(Material& material)
-{
-    get_renderer()->update_material_uniform(material.roughness, material.metallic, material.normals.get_id() != 0);
-}
-
 void Renderer::send_global_uniforms()
 {
     // TODO: Not this! We need to know dimensions of the framebuffer we're rendering to!
@@ -211,20 +345,8 @@ void Renderer::send_global_uniforms()
     global_uniforms.view = sm::look_at(camera_pos, camera_target);
     global_uniforms.perspective = sm::perspective(fovy, aspect, near_clip, far_clip);
 
-    glBindBuffer(GL_UNIFORM_BUFFER, global_ubo);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GlobalUniforms), &global_uniforms);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-}
-
-void Renderer::update_material_uniform(f32 roughness, f32 metalness, bool has_normal_map)
-{
-    global_uniforms.material_properties.x = roughness;
-    global_uniforms.material_properties.y = metalness;
-    global_uniforms.material_properties.z = has_normal_map ? 1.0f : 0.0f;
-
-    glBindBuffer(GL_UNIFORM_BUFFER, global_ubo);
-    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(GlobalUniforms, material_properties), sizeof(sm::Vec4), &global_uniforms.material_properties);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    auto alloc = upload_ring->upload(&global_uniforms, sizeof(GlobalUniforms), upload_ring->get_uniform_alignment());
+    UploadRing::bind_range(GL_UNIFORM_BUFFER, 0, alloc);
 }
 
 }
@@ -0,0 +1,145 @@
+#include <cstring>
+#include <utility>
+
+#include "profiler.h"
+#include "renderqueue.h"
+
+namespace sr
+{
+
+namespace
+{
+
+// Positive floats order the same as their bit patterns, so the top bits
+// below the sign make a coarse depth that sorts correctly without needing
+// the near and far planes.
+u64 depth_bits(f32 depth, u32 bits)
+{
+    if (!(depth > 0.0f))
+    {
+        return 0;
+    }
+    u32 as_int;
+    std::memcpy(&as_int, &depth, sizeof(as_int));
+    return bits >= 31 ? as_int : as_int >> (31 - bits);
+}
+
+constexpr u32 RADIX_BITS = 8;
+constexpr u32 RADIX = 1 << RADIX_BITS;
+constexpr u32 N_DIGITS = 64 / RADIX_BITS;
+
+} // namespace
+
+RenderQueue::RenderQueue(const SortKeyLayout& layout)
+    : layout()
+{
+    set_layout(layout);
+}
+
+void RenderQueue::set_layout(const SortKeyLayout& layout)
+{
+    u32 total = 0;
+    for (u32 i = 0; i < layout.n_fields; i++)
+    {
+        total += layout.fields[i].bits;
+    }
+    assert(total <= 64 && "Sort key layout is wider than 64 bits");
+    (void)total;
+    this->layout = layout;
+}
+
+void RenderQueue::reserve(u32 n_packets)
+{
+    packets.reserve(n_packets);
+    entries.reserve(n_packets);
+    scratch.reserve(n_packets);
+}
+
+void RenderQueue::clear()
+{
+    packets.clear();
+    entries.clear();
+}
+
+void RenderQueue::push(const DrawPacket& packet)
+{
+    entries.push_back(Entry{ encode_key(packet), (u32)packets.size() });
+    packets.push_back(packet);
+}
+
+u64 RenderQueue::encode_key(const DrawPacket& packet) const
+{
+    u64 key = 0;
+    for (u32 i = 0; i < layout.n_fields; i++)
+    {
+        u32 bits = layout.fields[i].bits;
+        u64 mask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+        u64 value = 0;
+        switch (layout.fields[i].field)
+        {
+        case SortKeyField_Program: value = packet.program; break;
+        case SortKeyField_Material: value = packet.material; break;
+        case SortKeyField_Geometry: value = packet.geometry; break;
+        case SortKeyField_Depth: value = depth_bits(packet.depth, bits); break;
+        case SortKeyField_InvDepth: value = mask - (depth_bits(packet.depth, bits) & mask); break;
+        }
+        key = (bits >= 64 ? 0 : key << bits) | (value & mask);
+    }
+    return key;
+}
+
+void RenderQueue::sort()
+{
+    SR_PROFILE_SCOPE("RenderQueue::sort");
+
+    u32 n = entries.size();
+    if (n < 2)
+    {
+        return;
+    }
+    scratch.resize(n);
+
+    // every digit's histogram in one pass over the keys
+    u32 counts[N_DIGITS][RADIX] = {};
+    for (auto& entry : entries)
+    {
+        for (u32 d = 0; d < N_DIGITS; d++)
+        {
+            counts[d][(entry.key >> (d * RADIX_BITS)) & (RADIX - 1)]++;
+        }
+    }
+
+    Entry* src = entries.data();
+    Entry* dst = scratch.data();
+    for (u32 d = 0; d < N_DIGITS; d++)
+    {
+        u32* count = counts[d];
+        u32 shift = d * RADIX_BITS;
+
+        // all keys share this digit, which is most of them with narrow fields
+        if (count[(src[0].key >> shift) & (RADIX - 1)] == n)
+        {
+            continue;
+        }
+
+        u32 offset = 0;
+        for (u32 b = 0; b < RADIX; b++)
+        {
+            u32 c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (u32 i = 0; i < n; i++)
+        {
+            dst[count[(src[i].key >> shift) & (RADIX - 1)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != entries.data())
+    {
+        std::swap(entries, scratch);
+    }
+}
+
+} // namespace sr
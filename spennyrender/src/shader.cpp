@@ -1,6 +1,15 @@
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <glad/glad.h>
 
+#include "framestats.h"
+#include "gldebug.h"
+#include "glstate.h"
+#include "profiler.h"
+#include "programcache.h"
 #include "shader.h"
 
 namespace sr
@@ -19,77 +28,389 @@ check_shader_status(GLuint id, bool prog)
     if (!success) {
         if (prog) {
             glGetProgramInfoLog(id, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::LINK_FAIL\n" << glGetError() << std::endl << infoLog << std::endl;
+            std::cerr << "ERROR::SHADER::LINK_FAIL\n" << infoLog << std::endl;
         } else {
             glGetShaderInfoLog(id, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::COMP_FAILED\n" << infoLog << std::endl;
+            std::cerr << "ERROR::SHADER::COMP_FAILED\n" << infoLog << std::endl;
         }
     }
     return success;
 }
 
-bool Shader::load_program(const std::string& vs_src, const std::string& fs_src)
+namespace
 {
+
+u64 now_ns()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+std::unordered_map<std::string, std::string>& shared_sources()
+{
+    static std::unordered_map<std::string, std::string> sources;
+    return sources;
+}
+
+bool has_parallel_compile()
+{
+    // both report GL_COMPLETION_STATUS_KHR, the ARB version is the same enum
+    return GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+}
+
+} // namespace
+
+bool Shader::load_program(const std::string& vs_src, const std::string& fs_src, const std::string& defines)
+{
+    SR_PROFILE_SCOPE("Shader::load_program");
+    submit_program(vs_src, fs_src, defines);
+    return finish_program();
+}
+
+void Shader::load_program_async(const std::string& vs_src, const std::string& fs_src, const std::string& defines)
+{
+    SR_PROFILE_SCOPE("Shader::load_program_async");
+    submit_program(vs_src, fs_src, defines);
+}
+
+bool Shader::is_ready()
+{
+    if (status == ProgramStatus_Pending)
+    {
+        GLint done = GL_TRUE;
+        if (has_parallel_compile())
+        {
+            glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &done);
+        }
+        if (done)
+        {
+            finish_program();
+        }
+    }
+    return status == ProgramStatus_Ready;
+}
+
+void Shader::add_shared_source(const std::string& name, const std::string& src)
+{
+    shared_sources()[name] = src;
+}
+
+std::string Shader::expand_source(const std::string& src, const std::string& defines)
+{
+    const std::string_view INCLUDE = "#include \"";
+
+    std::string out;
+    out.reserve(src.size() + defines.size());
+    bool seen_version = false;
+    usize pos = 0;
+    while (pos < src.size())
+    {
+        usize end = src.find('\n', pos);
+        end = end == std::string::npos ? src.size() : end + 1;
+        std::string_view line(src.data() + pos, end - pos);
+        pos = end;
+
+        if (line.starts_with(INCLUDE))
+        {
+            auto name = line.substr(INCLUDE.size());
+            name = name.substr(0, name.find('"'));
+            auto it = shared_sources().find(std::string(name));
+            if (it == shared_sources().end())
+            {
+                std::cout << "ERROR::SHADER::NO_SHARED_SOURCE " << name << std::endl;
+                continue;
+            }
+            out += it->second;
+            continue;
+        }
+
+        out += line;
+        // #version has to stay the first thing in the shader
+        if (!seen_version && line.starts_with("#version"))
+        {
+            seen_version = true;
+            if (out.back() != '\n')
+            {
+                out += '\n';
+            }
+            out += defines;
+        }
+    }
+    if (!seen_version)
+    {
+        out.insert(0, defines);
+    }
+    return out;
+}
+
+// Everything up to glLinkProgram, no status queries so nothing here waits on
+// the compiler
+void Shader::submit_program(const std::string& vs_src_in, const std::string& fs_src_in, const std::string& defines)
+{
+    std::string vs_src = expand_source(vs_src_in, defines);
+    std::string fs_src = expand_source(fs_src_in, defines);
+
+    cache_key = 0;
+    if (ProgramCache::enabled())
+    {
+        cache_key = ProgramCache::program_key(vs_src, fs_src, defines);
+        GLuint cached = ProgramCache::load(cache_key);
+        if (cached)
+        {
+            this->id = cached;
+            reflect();
+            status = ProgramStatus_Ready;
+            return;
+        }
+    }
+
+    compile_start_ns = now_ns();
     auto vs = glCreateShader(GL_VERTEX_SHADER);
+    auto fs = glCreateShader(GL_FRAGMENT_SHADER);
 
     const char *vs_csrc = vs_src.c_str();
     const char *fs_csrc = fs_src.c_str();
     glShaderSource(vs, 1, &vs_csrc, nullptr);
     glCompileShader(vs);
-    if (!check_shader_status(vs, false)) {
-        std::cerr << "vertex failed" << std::endl;
-        return false;
-    }
-
-    auto fs = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fs, 1, &fs_csrc, nullptr);
     glCompileShader(fs);
-    if (!check_shader_status(fs, false)) {
-        std::cerr << "frag failed" << std::endl;
-        return false;
-    }
 
     auto shader_id = glCreateProgram();
     glAttachShader(shader_id, vs);
     glAttachShader(shader_id, fs);
+    if (ProgramCache::enabled())
+    {
+        glProgramParameteri(shader_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(shader_id);
-    if (!check_shader_status(shader_id, true)) {
+
+    this->id = shader_id;
+    pending_vs = vs;
+    pending_fs = fs;
+    status = ProgramStatus_Pending;
+}
+
+bool Shader::finish_program()
+{
+    if (status != ProgramStatus_Pending)
+    {
+        return status == ProgramStatus_Ready;
+    }
+
+    bool ok = true;
+    if (!check_shader_status(pending_vs, false)) {
+        std::cerr << "vertex failed" << std::endl;
+        ok = false;
+    }
+    else if (!check_shader_status(pending_fs, false)) {
+        std::cerr << "frag failed" << std::endl;
+        ok = false;
+    }
+    else if (!check_shader_status(id, true)) {
         std::cerr << "link failed" << std::endl;
+        ok = false;
+    }
+
+    // the linked program keeps what it needs
+    glDetachShader(id, pending_vs);
+    glDetachShader(id, pending_fs);
+    glDeleteShader(pending_vs);
+    glDeleteShader(pending_fs);
+    pending_vs = 0;
+    pending_fs = 0;
+
+    if (!ok)
+    {
+        glDeleteProgram(id);
+        id = 0;
+        status = ProgramStatus_Failed;
         return false;
     }
 
-    this->id = shader_id;
+    if (ProgramCache::enabled())
+    {
+        ProgramCache::store(cache_key, id, now_ns() - compile_start_ns);
+    }
+
+    reflect();
+    status = ProgramStatus_Ready;
     return true;
 }
 
+void Shader::reflect()
+{
+    uniforms.clear();
+    uniform_blocks.clear();
+
+    GLint n_uniforms = 0;
+    GLint max_len = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &n_uniforms);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+    std::string name(max_len, '\0');
+    for (GLint i = 0; i < n_uniforms; i++)
+    {
+        GLsizei len;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(id, i, max_len, &len, &size, &type, name.data());
+
+        // members of uniform blocks have no location
+        GLint location = glGetUniformLocation(id, name.c_str());
+        if (location < 0)
+        {
+            continue;
+        }
+        uniforms.push_back(UniformInfo{ sm::dbj2(name.data(), len), name.substr(0, len), location, type });
+
+        // arrays are reported as name[0], make the bare name work too
+        if (len > 3 && !name.compare(len - 3, 3, "[0]"))
+        {
+            uniforms.push_back(UniformInfo{ sm::dbj2(name.data(), len - 3), name.substr(0, len - 3), location, type });
+        }
+    }
+
+    GLint n_blocks = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &n_blocks);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_len);
+    name.assign(max_len, '\0');
+    for (GLint i = 0; i < n_blocks; i++)
+    {
+        GLsizei len;
+        glGetActiveUniformBlockName(id, i, max_len, &len, name.data());
+        uniform_blocks.push_back(UniformBlockInfo{ sm::dbj2(name.data(), len), name.substr(0, len), (GLuint)i });
+    }
+
+    std::sort(uniforms.begin(), uniforms.end(), [](auto& a, auto& b) { return a.hash < b.hash; });
+    std::sort(uniform_blocks.begin(), uniform_blocks.end(), [](auto& a, auto& b) { return a.hash < b.hash; });
+}
+
+const Shader::UniformInfo* Shader::find_uniform(UniformName name) const
+{
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name.hash,
+                               [](const UniformInfo& info, u64 h) { return info.hash < h; });
+    // names that share a hash sit next to each other
+    for (; it != uniforms.end() && it->hash == name.hash; it++)
+    {
+        if (it->name == name.name)
+        {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+bool Shader::type_matches(GLenum type, GLenum expected)
+{
+    if (type == expected)
+    {
+        return true;
+    }
+    if (expected != GL_INT)
+    {
+        return false;
+    }
+
+    // samplers and bools are set as ints
+    switch (type)
+    {
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_SAMPLER_CUBE_MAP_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+GLint Shader::get_uniform_location(UniformName name) const
+{
+    auto* info = find_uniform(name);
+    return info ? info->location : -1;
+}
+
+GLuint Shader::get_uniform_block_index(UniformName name) const
+{
+    for (auto& block : uniform_blocks)
+    {
+        if (block.hash == name.hash && block.name == name.name)
+        {
+            return block.index;
+        }
+    }
+    return GL_INVALID_INDEX;
+}
+
+void Shader::bind_uniform_block(UniformName name, u32 binding)
+{
+    GLuint index = get_uniform_block_index(name);
+    if (index != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(id, index, binding);
+    }
+}
+
+void Shader::set_label(const char* label)
+{
+    SR_GL_LABEL(GL_PROGRAM, id, label);
+    (void)label;
+}
+
 void Shader::use_program()
 {
-    glUseProgram(this->id);
+    GLState::use_program(active()->id);
+}
+
+void Shader::set_uniform_mat4(UniformName name, const sm::Mat4& mat)
+{
+    set_uniform(UniformHandle<sm::Mat4>{ active()->get_uniform_location(name) }, mat);
+}
+
+void Shader::set_uniform_vec3(UniformName name, const sm::Vec3& v3)
+{
+    set_uniform(UniformHandle<sm::Vec3>{ active()->get_uniform_location(name) }, v3);
+}
+
+void Shader::set_uniform_int(UniformName name, const i32 val)
+{
+    set_uniform(UniformHandle<i32>{ active()->get_uniform_location(name) }, val);
+}
+
+void Shader::set_uniform_float(UniformName name, const f32 val)
+{
+    set_uniform(UniformHandle<f32>{ active()->get_uniform_location(name) }, val);
 }
 
-void Shader::set_uniform_mat4(const std::string& name, const sm::Mat4& mat)
+void Shader::set_uniform(UniformHandle<sm::Mat4> handle, const sm::Mat4& mat)
 {
-    glUniformMatrix4fv(glGetUniformLocation(this->id, name.c_str()),
-                        1,
-                        GL_FALSE,
-                        reinterpret_cast<const f32*>(&mat));
+    FrameStatsCounter::current().uniform_calls++;
+    glUniformMatrix4fv(handle.location, 1, GL_FALSE, reinterpret_cast<const f32*>(&mat));
 }
 
-void Shader::set_uniform_vec3(const std::string& name, const sm::Vec3& v3)
+void Shader::set_uniform(UniformHandle<sm::Vec3> handle, const sm::Vec3& v3)
 {
-    glUniform3fv(glGetUniformLocation(this->id, name.c_str()),
-                                      1, reinterpret_cast<const f32*>(&v3));
+    FrameStatsCounter::current().uniform_calls++;
+    glUniform3fv(handle.location, 1, reinterpret_cast<const f32*>(&v3));
 }
 
-void Shader::set_uniform_int(const std::string& name, const i32 val)
+void Shader::set_uniform(UniformHandle<i32> handle, const i32 val)
 {
-    auto loc = glGetUniformLocation(this->id, name.c_str());
-    glUniform1i(loc, val);
+    FrameStatsCounter::current().uniform_calls++;
+    glUniform1i(handle.location, val);
 }
 
-void Shader::set_uniform_float(const std::string& name, const f32 val)
+void Shader::set_uniform(UniformHandle<f32> handle, const f32 val)
 {
-    glUniform1f(glGetUniformLocation(this->id, name.c_str()), val);
+    FrameStatsCounter::current().uniform_calls++;
+    glUniform1f(handle.location, val);
 }
 
 } // namespace sr
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "profiler.h"
+#include "shadervariants.h"
+
+namespace sr
+{
+
+namespace
+{
+
+struct FeatureName
+{
+    u32 feature;
+    const char* name;
+    const char* define;
+};
+
+const FeatureName FEATURE_NAMES[] = {
+    { ShaderFeature_NormalMap, "normal_map", "SR_NORMAL_MAP" },
+    { ShaderFeature_AlphaTest, "alpha_test", "SR_ALPHA_TEST" },
+};
+
+const char LIGHTS_PREFIX[] = "lights=";
+
+// the manifest's spelling of a key, space separated
+std::string feature_names(u32 features)
+{
+    std::string names;
+    const char* sep = "";
+    for (auto& f : FEATURE_NAMES)
+    {
+        if (features & f.feature)
+        {
+            names += sep;
+            names += f.name;
+            sep = " ";
+        }
+    }
+    u32 n_lights = (features & ShaderFeature_LightCountMask) >> ShaderFeature_LightCountShift;
+    if (n_lights)
+    {
+        names += sep;
+        names += LIGHTS_PREFIX + std::to_string(n_lights);
+    }
+    return names;
+}
+
+} // namespace
+
+std::string shader_feature_defines(u32 features)
+{
+    std::string defines;
+    for (auto& f : FEATURE_NAMES)
+    {
+        if (features & f.feature)
+        {
+            defines += "#define ";
+            defines += f.define;
+            defines += "\n";
+        }
+    }
+    u32 n_lights = (features & ShaderFeature_LightCountMask) >> ShaderFeature_LightCountShift;
+    if (n_lights)
+    {
+        defines += "#define SR_LIGHT_COUNT " + std::to_string(n_lights) + "\n";
+    }
+    return defines;
+}
+
+ShaderVariants::ShaderVariants(const std::string& vs_src, const std::string& fs_src, Shader* fallback)
+    : vs_src(vs_src), fs_src(fs_src), fallback(fallback)
+{
+}
+
+Shader& ShaderVariants::get(u32 features)
+{
+    auto it = variants.find(features);
+    if (it != variants.end())
+    {
+        return *it->second;
+    }
+
+    SR_PROFILE_SCOPE("ShaderVariants::compile");
+    auto variant = std::make_unique<Shader>();
+    variant->set_fallback(fallback);
+    variant->load_program_async(vs_src, fs_src, shader_feature_defines(features));
+#ifdef SPENNY_RENDER_DEBUG
+    variant->set_label(("variant " + feature_names(features)).c_str());
+#endif
+    request_order.push_back(features);
+    return *variants.emplace(features, std::move(variant)).first->second;
+}
+
+void ShaderVariants::update()
+{
+    for (auto& [features, variant] : variants)
+    {
+        if (variant->get_status() == ProgramStatus_Pending)
+        {
+            variant->is_ready();
+        }
+    }
+}
+
+void ShaderVariants::prewarm(const std::vector<u32>& keys)
+{
+    for (u32 features : keys)
+    {
+        get(features);
+    }
+}
+
+bool ShaderVariants::wait_all()
+{
+    bool ok = true;
+    for (auto& [features, variant] : variants)
+    {
+        ok &= variant->wait_ready();
+    }
+    return ok;
+}
+
+bool ShaderVariants::prewarm_from_manifest(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream words(line);
+        std::string word;
+        u32 features = ShaderFeature_None;
+        while (words >> word)
+        {
+            if (!word.compare(0, sizeof(LIGHTS_PREFIX) - 1, LIGHTS_PREFIX))
+            {
+                u32 n_lights = std::strtoul(word.c_str() + sizeof(LIGHTS_PREFIX) - 1, nullptr, 10);
+                features = shader_features_with_lights(features, std::min(n_lights, 0xffu));
+                continue;
+            }
+
+            bool known = false;
+            for (auto& f : FEATURE_NAMES)
+            {
+                if (word == f.name)
+                {
+                    features |= f.feature;
+                    known = true;
+                }
+            }
+            if (!known)
+            {
+                std::cout << "Shader manifest " << path << ": unknown feature " << word << std::endl;
+            }
+        }
+        get(features);
+    }
+    return true;
+}
+
+bool ShaderVariants::write_manifest(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    for (u32 features : request_order)
+    {
+        out << feature_names(features) << "\n";
+    }
+    return (bool)out;
+}
+
+} // namespace sr
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <random>
+#include <glad/glad.h>
+
+#include "alloctrack.h"
+#include "stressscene.h"
+#include "texture.h"
+
+namespace sr
+{
+
+u64 StressScene::geometry_bytes() const
+{
+    u64 bytes = 0;
+    for (auto& mesh : model.meshes)
+    {
+        bytes += mesh.verts.size() * sizeof(Vertex);
+        bytes += mesh.indices.size() * sizeof(u32);
+    }
+    return bytes;
+}
+
+// A sphere with its radius wobbled by a few random sine waves, so every
+// mesh is different but still closed and well behaved.
+static Mesh generate_blob(std::mt19937& rng, u32 detail)
+{
+    const f32 PI = std::acos(-1.0f);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+
+    f32 freq_a = 1 + (u32)(unit(rng) * 5);
+    f32 freq_b = 1 + (u32)(unit(rng) * 5);
+    f32 amp = 0.05f + unit(rng) * 0.2f;
+    f32 phase = unit(rng) * 2 * PI;
+
+    u32 rings = std::max<u32>(detail, 2);
+    u32 segments = rings * 2;
+
+    Mesh mesh;
+    mesh.material_index = 0;
+    mesh.verts.reserve((rings + 1) * (segments + 1));
+    for (u32 ring = 0; ring <= rings; ring++)
+    {
+        f32 v = (f32)ring / rings;
+        f32 theta = v * PI;
+        for (u32 seg = 0; seg <= segments; seg++)
+        {
+            f32 u = (f32)seg / segments;
+            f32 phi = u * 2 * PI;
+
+            sm::Vec3 dir = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+            f32 radius = 0.5f + amp * std::sin(freq_a * phi + phase) * std::sin(freq_b * theta);
+
+            Vertex vert;
+            vert.pos = dir * radius;
+            // the wobble is small, the sphere normal is close enough
+            vert.norm = dir;
+            vert.tan = sm::Vec3{ -std::sin(phi), 0, std::cos(phi) };
+            vert.bitan = sm::cross(vert.norm, vert.tan);
+            vert.uv = sm::Vec2{ u, v };
+            mesh.verts.push_back(vert);
+        }
+    }
+
+    mesh.indices.reserve(rings * segments * 6);
+    for (u32 ring = 0; ring < rings; ring++)
+    {
+        for (u32 seg = 0; seg < segments; seg++)
+        {
+            u32 a = ring * (segments + 1) + seg;
+            u32 b = a + segments + 1;
+            mesh.indices.push_back(a);
+            mesh.indices.push_back(b);
+            mesh.indices.push_back(a + 1);
+            mesh.indices.push_back(a + 1);
+            mesh.indices.push_back(b);
+            mesh.indices.push_back(b + 1);
+        }
+    }
+
+    return mesh;
+}
+
+// Two-colour checkerboard with a random cell size
+static Texture generate_texture(std::mt19937& rng, u32 size)
+{
+    std::uniform_int_distribution<u32> byte(0, 255);
+    std::uniform_int_distribution<u32> cell_shift(2, 5);
+
+    u8 a[4] = { (u8)byte(rng), (u8)byte(rng), (u8)byte(rng), 255 };
+    u8 b[4] = { (u8)byte(rng), (u8)byte(rng), (u8)byte(rng), 255 };
+    u32 shift = cell_shift(rng);
+
+    std::vector<u8> pixels(size * size * 4);
+    for (u32 y = 0; y < size; y++)
+    {
+        for (u32 x = 0; x < size; x++)
+        {
+            const u8* c = (((x >> shift) ^ (y >> shift)) & 1) ? a : b;
+            u8* px = &pixels[(y * size + x) * 4];
+            px[0] = c[0];
+            px[1] = c[1];
+            px[2] = c[2];
+            px[3] = c[3];
+        }
+    }
+
+    Texture result;
+    result.load_texture(size, size, pixels.data(), GL_SRGB_ALPHA, GL_REPEAT);
+    return result;
+}
+
+static void generate_materials(std::mt19937& rng, const StressSceneConfig& config, u32 flags, StressScene* scene)
+{
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+
+    std::vector<Texture> textures;
+    if (!(flags & StressSceneFlags_NoTextures))
+    {
+        for (u32 i = 0; i < config.n_textures; i++)
+        {
+            textures.push_back(generate_texture(rng, config.texture_size));
+            scene->texture_bytes += (u64)config.texture_size * config.texture_size * 4;
+        }
+    }
+
+    scene->model.materials.resize(config.n_materials);
+    for (u32 i = 0; i < config.n_materials; i++)
+    {
+        auto& material = scene->model.materials[i];
+        material.metallic = unit(rng);
+        material.roughness = 0.1f + unit(rng) * 0.9f;
+        if (!textures.empty())
+        {
+            material.diffuse = textures[i % textures.size()];
+        }
+    }
+}
+
+static sm::Transform random_transform(std::mt19937& rng, f32 extent)
+{
+    std::uniform_real_distribution<f32> pos(-extent / 2, extent / 2);
+    std::uniform_real_distribution<f32> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<f32> scale(0.5f, 2.0f);
+
+    sm::Transform t;
+    t.translation = sm::Vec3{ pos(rng), 0, pos(rng) };
+    t.rotation = sm::quat_axis_angle(sm::Vec3{0, 1, 0}, angle(rng));
+    f32 s = scale(rng);
+    t.scale = sm::Vec3{ s, s, s };
+    return t;
+}
+
+static void generate_lights(std::mt19937& rng, const StressSceneConfig& config, StressScene* scene)
+{
+    std::uniform_real_distribution<f32> pos(-config.extent / 2, config.extent / 2);
+    std::uniform_real_distribution<f32> height(1.0f, 4.0f);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+
+    // keep the total light roughly constant as the count goes up
+    f32 intensity = 16.0f / std::max<u32>(config.n_lights, 1);
+
+    scene->lights.reserve(config.n_lights);
+    for (u32 i = 0; i < config.n_lights; i++)
+    {
+        PointLight light;
+        light.position = sm::Vec3{ pos(rng), height(rng), pos(rng) };
+        light.color = sm::Vec3{ 0.5f + unit(rng), 0.5f + unit(rng), 0.5f + unit(rng) } * intensity;
+        scene->lights.push_back(light);
+    }
+}
+
+StressScene StressSceneGenerator::generate(const StressSceneConfig& config, u32 flags)
+{
+    SR_ALLOC_TAG("stress_scene");
+    assert(config.n_meshes > 0 && "need at least one mesh");
+    assert(config.n_materials > 0 && "need at least one material");
+
+    std::mt19937 rng(config.seed);
+    StressScene scene;
+    scene.texture_bytes = 0;
+
+    scene.model.meshes.reserve(config.n_meshes);
+    for (u32 i = 0; i < config.n_meshes; i++)
+    {
+        scene.model.meshes.push_back(generate_blob(rng, config.mesh_detail));
+    }
+
+    generate_materials(rng, config, flags, &scene);
+
+    std::uniform_int_distribution<u32> mesh_idx(0, config.n_meshes - 1);
+    std::uniform_int_distribution<u32> material_idx(0, config.n_materials - 1);
+    scene.instances.reserve(config.n_instances);
+    for (u32 i = 0; i < config.n_instances; i++)
+    {
+        MeshInstance instance;
+        instance.mesh = mesh_idx(rng);
+        instance.material = material_idx(rng);
+        instance.transform = random_transform(rng, config.extent);
+        scene.instances.push_back(instance);
+    }
+
+    generate_lights(rng, config, &scene);
+    return scene;
+}
+
+StressScene StressSceneGenerator::generate(const StressSceneConfig& config, const Model& source, u32 flags)
+{
+    SR_ALLOC_TAG("stress_scene");
+    std::mt19937 rng(config.seed);
+    StressScene scene;
+    scene.texture_bytes = 0;
+    scene.model.meshes = source.meshes;
+
+    bool keep_materials = config.n_materials == 0;
+    if (keep_materials)
+    {
+        scene.model.materials = source.materials;
+    }
+    else
+    {
+        generate_materials(rng, config, flags, &scene);
+    }
+
+    // every instance places the whole source model
+    std::uniform_int_distribution<u32> material_idx(0, std::max<u32>(config.n_materials, 1) - 1);
+    scene.instances.reserve(config.n_instances * source.meshes.size());
+    for (u32 i = 0; i < config.n_instances; i++)
+    {
+        auto transform = random_transform(rng, config.extent);
+        MaterialIndex material = material_idx(rng);
+        for (u32 mesh = 0; mesh < source.meshes.size(); mesh++)
+        {
+            MeshInstance instance;
+            instance.mesh = mesh;
+            instance.material = keep_materials ? source.meshes[mesh].material_index : material;
+            instance.transform = transform;
+            scene.instances.push_back(instance);
+        }
+    }
+
+    generate_lights(rng, config, &scene);
+    return scene;
+}
+
+} // namespace sr
@@ -2,7 +2,12 @@
 #include <stb_image.h>
 #include "renderer.h"
 #include "spennymath.h"
+#include "alloctrack.h"
 #include "framebuf.h"
+#include "framestats.h"
+#include "gldebug.h"
+#include "glstate.h"
+#include "profiler.h"
 #include "texture.h"
 #include "spennytypes.h"
 
@@ -12,7 +17,7 @@ namespace sr
 void Texture::alloc_texture(i32 w, i32 h, u32 wrap, u32 filter)
 {
     glGenTextures(1, &this->id);
-    glBindTexture(GL_TEXTURE_2D, this->id);
+    GLState::bind_texture(GL_TEXTURE_2D, this->id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
@@ -30,7 +35,7 @@ void Texture::alloc_texture(i32 w, i32 h, u32 wrap, u32 filter)
                  nullptr);
     glGenerateMipmap(GL_TEXTURE_2D);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
     this->w = w;
     this->h = h;
 }
@@ -38,7 +43,7 @@ void Texture::alloc_texture(i32 w, i32 h, u32 wrap, u32 filter)
 void Texture::load_texture(i32 w, i32 h, u8* data, u32 src_fmt, u32 wrap, u32 filter)
 {
     glGenTextures(1, &this->id);
-    glBindTexture(GL_TEXTURE_2D, this->id);
+    GLState::bind_texture(GL_TEXTURE_2D, this->id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
@@ -56,15 +61,14 @@ void Texture::load_texture(i32 w, i32 h, u8* data, u32 src_fmt, u32 wrap, u32 fi
                  data);
     glGenerateMipmap(GL_TEXTURE_2D);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
     this->w = w;
     this->h = h;
 }
 
 void Texture::bind_texture(u32 slot)
 {
-    glActiveTexture(slot);
-    glBindTexture(GL_TEXTURE_2D, this->id);
+    GLState::bind_texture(slot, GL_TEXTURE_2D, this->id);
 }
 
 Texture TextureBuilder::build()
@@ -73,13 +77,9 @@ Texture TextureBuilder::build()
     result.w = width;
     result.h = height;
     glGenTextures(1, &result.id);
-    glBindTexture(type, result.id);
-
-    glTexParameteri(type, GL_TEXTURE_WRAP_S, wrap);
-    glTexParameteri(type, GL_TEXTURE_WRAP_T, wrap);
-    glTexParameteri(type, GL_TEXTURE_MIN_FILTER, filter);
-    glTexParameteri(type, GL_TEXTURE_MAG_FILTER, filter);
+    GLState::bind_texture(type, result.id);
 
+    // multisample textures have no sampler state to set
     if (type == GL_TEXTURE_2D_MULTISAMPLE)
     {
         assert(samples > 0 && "Must set samples on multisampled texture");
@@ -92,6 +92,10 @@ Texture TextureBuilder::build()
     }
     else
     {
+        glTexParameteri(type, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(type, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(type, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(type, GL_TEXTURE_MAG_FILTER, filter);
         glTexImage2D(type,
                     level,
                     internal_format,
@@ -105,7 +109,7 @@ Texture TextureBuilder::build()
     }
 
 
-    glBindTexture(type, 0);
+    GLState::bind_texture(type, 0);
 
     return result;
 }
@@ -115,13 +119,9 @@ void TextureBuilder::build_into(Texture& result)
     result.w = width;
     result.h = height;
     glGenTextures(1, &result.id);
-    glBindTexture(type, result.id);
-
-    glTexParameteri(type, GL_TEXTURE_WRAP_S, wrap);
-    glTexParameteri(type, GL_TEXTURE_WRAP_T, wrap);
-    glTexParameteri(type, GL_TEXTURE_MIN_FILTER, filter);
-    glTexParameteri(type, GL_TEXTURE_MAG_FILTER, filter);
+    GLState::bind_texture(type, result.id);
 
+    // multisample textures have no sampler state to set
     if (type == GL_TEXTURE_2D_MULTISAMPLE)
     {
         assert(samples > 0 && "Must set samples on multisampled texture");
@@ -134,6 +134,10 @@ void TextureBuilder::build_into(Texture& result)
     }
     else
     {
+        glTexParameteri(type, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(type, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(type, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(type, GL_TEXTURE_MAG_FILTER, filter);
         glTexImage2D(type,
                     level,
                     internal_format,
@@ -146,12 +150,18 @@ void TextureBuilder::build_into(Texture& result)
         glGenerateMipmap(type);
     }
 
-    glBindTexture(type, 0);
+    GLState::bind_texture(type, 0);
 }
 
 void Texture::unbind()
 {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bind_texture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::set_label(const char* label)
+{
+    SR_GL_LABEL(GL_TEXTURE, id, label);
+    (void)label;
 }
 
 GLuint Texture::get_id() const noexcept
@@ -161,12 +171,12 @@ GLuint Texture::get_id() const noexcept
 
 void Cubemap::bind()
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+    GLState::bind_texture(GL_TEXTURE_CUBE_MAP, id);
 }
 
 void Cubemap::unbind()
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLState::bind_texture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 void Cubemap::buffer_face(i32 face, i32 w, i32 h, const u8* data)
@@ -180,14 +190,7 @@ const char* skybox_vs = R"SRC(
 
 layout (location = 0) in vec3 position;
 
-layout (std140) uniform GlobalUniforms
-{
-    vec4 clip;
-    vec4 camera_pos;
-    vec4 material_props;
-    mat4 view;
-    mat4 perspective;
-};
+#include "global_uniforms"
 
 out vec3 uv_pos;
 
@@ -300,11 +303,20 @@ void Skybox::load_from_dir(const std::string& dir)
 
 void Skybox::load_from_hdr(const std::string& hdr)
 {
+    SR_PROFILE_SCOPE("Skybox::load_from_hdr");
+    SR_ALLOC_TAG("textures");
+    SR_GL_DEBUG_GROUP("Skybox::load_from_hdr");
     assert(cubemap.get_id() != 0 && "Bad cubemap");
 
     int w, h, c;
     f32* data = stbi_loadf(hdr.c_str(), &w, &h, &c, 0);
-    assert(data && "Bad hdr image");
+    if (!data)
+    {
+        // w and h are garbage, carry on with an empty cubemap instead
+        std::cout << "Failed to load " << hdr << ": " << stbi_failure_reason() << std::endl;
+        shader.load_program(skybox_vs, skybox_fs);
+        return;
+    }
 
     TextureBuilder builder;
     Texture hdr_tex = builder
@@ -340,14 +352,16 @@ void Skybox::load_from_hdr(const std::string& hdr)
     framebuf.bind();
 
     Shader cubemap_convert_shader;
-    assert(cubemap_convert_shader.load_program(cubecvt_vs, cubecvt_fs) && "Shader failed");
+    bool convert_loaded = cubemap_convert_shader.load_program(cubecvt_vs, cubecvt_fs);
+    assert(convert_loaded && "Shader failed");
+    (void)convert_loaded;
     cubemap_convert_shader.use_program();
     cubemap_convert_shader.set_uniform_mat4("projection", persp);
 
     cubemap.bind();
     hdr_tex.bind_texture(GL_TEXTURE0);
     cubemap_convert_shader.set_uniform_int("equi_map", 0);
-    glBindVertexArray(cube_vao);
+    GLState::bind_vertex_array(cube_vao);
     for (u32 face = 0; face < CubemapFace_NFaces; face++)
     {
         // TODO: cubemap class should be handled by texture
@@ -363,9 +377,10 @@ void Skybox::load_from_hdr(const std::string& hdr)
         glDrawArrays(GL_TRIANGLES, 0, 36);
     }
     framebuf.unbind();
-    glBindVertexArray(0);
 
     shader.load_program(skybox_vs, skybox_fs);
+    shader.set_label("skybox");
+    SR_GL_LABEL(GL_TEXTURE, cubemap.get_id(), "skybox");
 }
 
 f32 cube_verts[] = {
@@ -421,14 +436,15 @@ void Skybox::buffer_cube()
     u32 vbo;
     glGenBuffers(1, &vbo);
 
-    glBindVertexArray(cube_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // names only exist once bound, labelling before fails
+    GLState::bind_vertex_array(cube_vao);
+    GLState::bind_buffer(GL_ARRAY_BUFFER, vbo);
+    SR_GL_LABEL(GL_VERTEX_ARRAY, cube_vao, "skybox cube");
+    SR_GL_LABEL(GL_BUFFER, vbo, "skybox cube");
 
     glBufferData(GL_ARRAY_BUFFER, N_VERTS * 3 * sizeof(f32), cube_verts, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(f32) * 3, (void*)0);
     glEnableVertexAttribArray(0);
-
-    glBindVertexArray(0);
 }
 
 void Skybox::render()
@@ -438,18 +454,15 @@ void Skybox::render()
         buffer_cube();
     }
 
-    glBindVertexArray(cube_vao);
+    GLState::bind_vertex_array(cube_vao);
 
-    glActiveTexture(GL_TEXTURE0);
+    GLState::active_texture(GL_TEXTURE0);
     cubemap.bind();
 
     shader.use_program();
     shader.set_uniform_int("cubetex", 0);
 
     glDrawArrays(GL_TRIANGLES, 0, 36);
-
-    cubemap.unbind();
-    glBindVertexArray(0);
 }
 
 } // namespace sr
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "framestats.h"
+#include "gldebug.h"
+#include "glstate.h"
+#include "profiler.h"
+#include "uploadring.h"
+
+namespace sr
+{
+
+namespace
+{
+
+constexpr GLbitfield STORAGE_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// how often a wait on a frame's fence warns that the GPU is behind
+constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+std::size_t align_up(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::size_t get_alignment(GLenum pname)
+{
+    GLint alignment = 0;
+    glGetIntegerv(pname, &alignment);
+    return alignment > 0 ? alignment : 256;
+}
+
+} // namespace
+
+UploadRing::UploadRing(std::size_t bytes_per_frame, u32 n_frames)
+    : buffer(0)
+      , mapped(nullptr)
+      , region_size(0)
+      , n_frames(n_frames)
+      , uniform_alignment(get_alignment(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT))
+      , storage_alignment(get_alignment(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT))
+      , frame_index(0)
+      , head(0)
+      , fences(n_frames, nullptr)
+{
+    assert(n_frames > 0 && "Upload ring needs at least one frame");
+    // Renderer::start fails without it
+    assert(GLAD_GL_ARB_buffer_storage && "Upload ring needs GL_ARB_buffer_storage");
+    create_buffer(bytes_per_frame);
+}
+
+void UploadRing::create_buffer(std::size_t bytes_per_frame)
+{
+    // regions start aligned for anything that gets bound out of them
+    region_size = align_up(bytes_per_frame, 256);
+
+    glGenBuffers(1, &buffer);
+    // any target works for creating it, this one isn't cached by GLState
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, region_size * n_frames, nullptr, STORAGE_FLAGS);
+    SR_GL_LABEL(GL_BUFFER, buffer, "UploadRing");
+    mapped = (u8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, region_size * n_frames, STORAGE_FLAGS);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    assert(mapped && "Failed to map the upload ring");
+}
+
+void UploadRing::grow(std::size_t min_bytes_per_frame)
+{
+    // the GPU may still read any region of the old buffer, including what
+    // this frame already wrote, so it's kept mapped until it's done
+    retired.push_back(Retired{ buffer, frame_index });
+    create_buffer(std::max(region_size * 2, min_bytes_per_frame));
+    head = 0;
+}
+
+void UploadRing::begin_frame()
+{
+    SR_PROFILE_SCOPE("UploadRing::begin_frame");
+
+    GLsync& fence = fences[frame_index % n_frames];
+    // the GPU is done with everything up to the last frame that used this
+    // region, unless the wait itself failed
+    bool frame_done = true;
+    if (fence)
+    {
+        // a slow GPU can still be reading the region, so there's no giving
+        // up on it, the timeout only paces the warnings
+        u32 n_timeouts = 0;
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        while (result == GL_TIMEOUT_EXPIRED)
+        {
+            n_timeouts++;
+            std::cerr << "Upload ring fence still not signaled after "
+                      << n_timeouts * (FENCE_TIMEOUT_NS / 1000000) << "ms" << std::endl;
+            result = glClientWaitSync(fence, 0, FENCE_TIMEOUT_NS);
+        }
+        if (result == GL_WAIT_FAILED)
+        {
+            std::cerr << "Waiting on the upload ring's fence failed" << std::endl;
+            frame_done = false;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    if (!frame_done)
+    {
+        head = 0;
+        return;
+    }
+
+    // the wait above covered the last frame that used these
+    u32 n_deleted = 0;
+    for (auto& old : retired)
+    {
+        if (old.frame + n_frames > frame_index)
+        {
+            break;
+        }
+        glDeleteBuffers(1, &old.buffer);
+        n_deleted++;
+    }
+    if (n_deleted > 0)
+    {
+        retired.erase(retired.begin(), retired.begin() + n_deleted);
+        // deleting unbinds them, the cache doesn't know that
+        GLState::invalidate();
+    }
+
+    head = 0;
+}
+
+void UploadRing::end_frame()
+{
+    fences[frame_index % n_frames] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_index++;
+}
+
+UploadAlloc UploadRing::allocate(std::size_t bytes, std::size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment has to be a power of two");
+
+    std::size_t offset = align_up(head, alignment);
+    if (offset + bytes > region_size)
+    {
+        grow(bytes + alignment);
+        offset = 0;
+    }
+    head = offset + bytes;
+
+    std::size_t region_start = (frame_index % n_frames) * region_size;
+    return UploadAlloc{ mapped + region_start + offset, buffer, region_start + offset, bytes };
+}
+
+UploadAlloc UploadRing::upload(const void* data, std::size_t bytes, std::size_t alignment)
+{
+    auto alloc = allocate(bytes, alignment);
+    std::memcpy(alloc.ptr, data, bytes);
+
+    auto& stats = FrameStatsCounter::current();
+    stats.buffer_uploads++;
+    stats.buffer_upload_bytes += bytes;
+    return alloc;
+}
+
+void UploadRing::bind_range(GLenum target, u32 index, const UploadAlloc& alloc)
+{
+    GLState::bind_buffer_range(target, index, alloc.buffer, alloc.offset, alloc.size);
+}
+
+} // namespace sr
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "vertpack.h"
+
+namespace sr
+{
+
+namespace
+{
+
+// below this a bounds axis is flat, and everything quantizes to 0 on it
+constexpr f32 MIN_EXTENT = 1e-6f;
+
+f32 sign_not_zero(f32 value)
+{
+    return value >= 0 ? 1.0f : -1.0f;
+}
+
+// a unit normal, or +Z for one that can't be normalized. A zero or NaN
+// normal would otherwise reach lround as NaN.
+sm::Vec3 unit_normal(const sm::Vec3& n)
+{
+    f32 length2 = sm::dot(n, n);
+    if (!(length2 > 1e-12f) || !std::isfinite(length2))
+    {
+        return sm::Vec3{ 0, 0, 1 };
+    }
+    return sm::norm(n);
+}
+
+// a unit tangent at right angles to n, from whatever the loader had
+sm::Vec3 orthogonal_tangent(const sm::Vec3& n, const sm::Vec3& tan)
+{
+    sm::Vec3 t = tan - n * sm::dot(n, tan);
+    if (sm::dot(t, t) > 1e-12f)
+    {
+        return sm::norm(t);
+    }
+    // no usable tangent, any perpendicular will do
+    sm::Vec3 axis = std::abs(n.x) < 0.9f ? sm::Vec3{ 1, 0, 0 } : sm::Vec3{ 0, 1, 0 };
+    return sm::norm(sm::cross(n, axis));
+}
+
+} // namespace
+
+u16 float_to_half(f32 value)
+{
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    u32 sign = (bits >> 16) & 0x8000;
+    u32 exponent = (bits >> 23) & 0xff;
+    u32 mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff)
+    {
+        // infinity stays infinity, NaN stays NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+
+    i32 half_exponent = (i32)exponent - 127 + 15;
+    if (half_exponent >= 0x1f)
+    {
+        return sign | 0x7c00;
+    }
+
+    u32 half;
+    u32 rest;
+    u32 halfway;
+    if (half_exponent <= 0)
+    {
+        // subnormal, or zero when it's too small for that
+        if (half_exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        u32 shift = 14 - half_exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        half = ((u32)half_exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+
+    // a carry out of the mantissa moves up to the next exponent, or infinity
+    if (rest > halfway || (rest == halfway && (half & 1)))
+    {
+        half++;
+    }
+    return sign | half;
+}
+
+i16 pack_snorm16(f32 value)
+{
+    return (i16)std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+u16 pack_unorm16(f32 value)
+{
+    return (u16)std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+u32 pack_snorm_1010102(const sm::Vec4& value)
+{
+    auto pack = [](f32 v, f32 max, u32 mask) {
+        return (u32)(i32)std::lround(std::clamp(v, -1.0f, 1.0f) * max) & mask;
+    };
+    return pack(value.x, 511.0f, 0x3ff)
+        | (pack(value.y, 511.0f, 0x3ff) << 10)
+        | (pack(value.z, 511.0f, 0x3ff) << 20)
+        | (pack(value.w, 1.0f, 0x3) << 30);
+}
+
+sm::Vec2 oct_encode(const sm::Vec3& n)
+{
+    f32 l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    sm::Vec2 e{ n.x / l1, n.y / l1 };
+    if (n.z < 0)
+    {
+        // the lower half folds out over the corners
+        e = sm::Vec2{ (1.0f - std::abs(e.y)) * sign_not_zero(e.x),
+                      (1.0f - std::abs(e.x)) * sign_not_zero(e.y) };
+    }
+    return e;
+}
+
+sm::Vec3 oct_decode(const sm::Vec2& e)
+{
+    sm::Vec3 n{ e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y) };
+    if (n.z < 0)
+    {
+        f32 x = (1.0f - std::abs(n.y)) * sign_not_zero(n.x);
+        f32 y = (1.0f - std::abs(n.x)) * sign_not_zero(n.y);
+        n.x = x;
+        n.y = y;
+    }
+    return sm::norm(n);
+}
+
+PackedVertices pack_vertices(const std::vector<Vertex>& verts)
+{
+    PackedVertices result;
+    result.dequantize = sm::mat4_I();
+    if (verts.empty())
+    {
+        return result;
+    }
+
+    sm::Vec3 min = verts[0].pos;
+    sm::Vec3 max = verts[0].pos;
+    for (auto& vert : verts)
+    {
+        min = sm::Vec3{ std::min(min.x, vert.pos.x), std::min(min.y, vert.pos.y), std::min(min.z, vert.pos.z) };
+        max = sm::Vec3{ std::max(max.x, vert.pos.x), std::max(max.y, vert.pos.y), std::max(max.z, vert.pos.z) };
+    }
+    sm::Vec3 extent{ std::max(max.x - min.x, MIN_EXTENT),
+                     std::max(max.y - min.y, MIN_EXTENT),
+                     std::max(max.z - min.z, MIN_EXTENT) };
+    result.dequantize = sm::translation_by(min) * sm::scale_by(extent);
+
+    result.positions.reserve(verts.size());
+    result.attributes.reserve(verts.size());
+    for (auto& vert : verts)
+    {
+        PackedPosition position;
+        position.pos[0] = pack_unorm16((vert.pos.x - min.x) / extent.x);
+        position.pos[1] = pack_unorm16((vert.pos.y - min.y) / extent.y);
+        position.pos[2] = pack_unorm16((vert.pos.z - min.z) / extent.z);
+        position.pos[3] = 0;
+
+        PackedAttributes packed;
+
+        sm::Vec3 n = unit_normal(vert.norm);
+        sm::Vec2 oct = oct_encode(n);
+        packed.norm[0] = pack_snorm16(oct.x);
+        packed.norm[1] = pack_snorm16(oct.y);
+
+        sm::Vec3 t = orthogonal_tangent(n, vert.tan);
+        f32 handedness = sm::dot(sm::cross(n, t), vert.bitan) < 0 ? -1.0f : 1.0f;
+        packed.tan = pack_snorm_1010102(sm::Vec4{ t.x, t.y, t.z, handedness });
+
+        packed.uv[0] = float_to_half(vert.uv.u);
+        packed.uv[1] = float_to_half(vert.uv.v);
+
+        result.positions.push_back(position);
+        result.attributes.push_back(packed);
+    }
+    return result;
+}
+
+} // namespace sr